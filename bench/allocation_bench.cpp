@@ -0,0 +1,112 @@
+#include <benchmark/benchmark.h>
+
+#include <communication/ServiceBroker.hpp>
+
+#include <cstddef>
+#include <string>
+
+// Counts heap allocations per broker call. Global operator new is replaced in
+// allocation_counter.cpp to count all allocations made by the process.
+
+// Number of allocations so far
+std::size_t allocation_count() noexcept;
+
+namespace {
+void add_services(ServiceBroker &broker, int nservices) {
+  for (int i = 0; i < nservices; ++i) {
+    Service<void, int> service("configuration.set.worker" + std::to_string(i));
+    service.service->connect([](int) {});
+    broker.add_service(service);
+    Service<int, int> result_service("configuration.get.worker" +
+                                     std::to_string(i));
+    result_service.service->connect([](int a) { return a; });
+    broker.add_service(result_service);
+  }
+}
+
+// Report average number of allocations per iteration
+void report(benchmark::State &state, std::size_t start) {
+  state.counters["allocs"] =
+      benchmark::Counter(static_cast<double>(allocation_count() - start),
+                         benchmark::Counter::kAvgIterations);
+}
+}
+
+// Call of a single service with a void return type
+static void BM_CallService(benchmark::State &state) {
+  ServiceBroker broker;
+  add_services(broker, 8);
+  auto start = allocation_count();
+  for (auto _ : state) {
+    broker.call<void>("configuration.set.worker0", 1);
+  }
+  report(state, start);
+}
+BENCHMARK(BM_CallService);
+
+// Call of a group of services with a void return type
+static void BM_CallGroup(benchmark::State &state) {
+  ServiceBroker broker;
+  add_services(broker, 8);
+  auto start = allocation_count();
+  for (auto _ : state) {
+    broker.call<void>("configuration.set", 1);
+  }
+  report(state, start);
+}
+BENCHMARK(BM_CallGroup);
+
+// Name, which has to be sanitized first
+static void BM_CallUnsanitizedName(benchmark::State &state) {
+  ServiceBroker broker;
+  add_services(broker, 8);
+  auto start = allocation_count();
+  for (auto _ : state) {
+    broker.call<void>(".configuration..set.worker0.", 1);
+  }
+  report(state, start);
+}
+BENCHMARK(BM_CallUnsanitizedName);
+
+// Call of a group of services returning a value. The returned vector is the
+// only allocation.
+static void BM_CallGroupWithResult(benchmark::State &state) {
+  ServiceBroker broker;
+  add_services(broker, 8);
+  auto start = allocation_count();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(broker.call<int>("configuration.get", 1));
+  }
+  report(state, start);
+}
+BENCHMARK(BM_CallGroupWithResult);
+
+// Call by symbol, which skips the name lookup
+static void BM_CallGroupBySymbol(benchmark::State &state) {
+  ServiceBroker broker;
+  add_services(broker, 8);
+  auto symbol = *broker.symbol("configuration.set");
+  auto start = allocation_count();
+  for (auto _ : state) {
+    broker.call<void>(symbol, 1);
+  }
+  report(state, start);
+}
+BENCHMARK(BM_CallGroupBySymbol);
+
+// Group call folded with a streaming combiner, which does not collect the
+// results into a vector
+static void BM_CallGroupFold(benchmark::State &state) {
+  ServiceBroker broker;
+  add_services(broker, 8);
+  auto sum = make_fold<int>(0, [](int acc, int result) { return acc + result; });
+  auto start = allocation_count();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        broker.call_combine<int>("configuration.get", sum, 1));
+  }
+  report(state, start);
+}
+BENCHMARK(BM_CallGroupFold);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,79 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Replaces the global operator new and delete to count all allocations made
+// by the process. Kept apart from allocation_bench.cpp, so that the
+// operators are not inlined into the calls of the benchmark.
+
+namespace {
+std::atomic<std::size_t> allocations{0};
+
+void *allocate(std::size_t size) noexcept {
+  ++allocations;
+  return std::malloc(size == 0 ? 1 : size);
+}
+}
+
+std::size_t allocation_count() noexcept { return allocations; }
+
+void *operator new(std::size_t size) {
+  if (auto ptr = allocate(size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void *operator new(std::size_t size, std::nothrow_t const &) noexcept {
+  return allocate(size);
+}
+
+void *operator new[](std::size_t size, std::nothrow_t const &) noexcept {
+  return allocate(size);
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::nothrow_t const &) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void *ptr, std::nothrow_t const &) noexcept {
+  std::free(ptr);
+}
+
+#if defined(__cpp_aligned_new)
+namespace {
+void *allocate(std::size_t size, std::align_val_t alignment) noexcept {
+  ++allocations;
+  auto align = static_cast<std::size_t>(alignment);
+  // Size of aligned_alloc must be a multiple of the alignment
+  return std::aligned_alloc(align, (size + align - 1) / align * align);
+}
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+  if (auto ptr = allocate(size == 0 ? 1 : size, alignment)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+  return operator new(size, alignment);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+#endif
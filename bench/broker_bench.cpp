@@ -0,0 +1,221 @@
+#include <benchmark/benchmark.h>
+
+#include <communication/Concat.hpp>
+#include <communication/ServiceBroker.hpp>
+
+#include <numeric>
+#include <string>
+#include <vector>
+
+// Hot paths of the broker: emission of a service to its slots, group calls,
+// registration of callbacks, listing of services and concatenation of
+// streams.
+
+namespace {
+// Add a group of services "group.service<i>", each with one slot
+void add_group(ServiceBroker &broker, int nservices) {
+  for (int i = 0; i < nservices; ++i) {
+    Service<int, int> service("group.service" + std::to_string(i));
+    service.service->connect([i](int a) { return a + i; });
+    broker.add_service(service);
+  }
+}
+
+// Add 8 services on every level of a chain of groups "g0.g1...g<depth>"
+void add_deep_tree(ServiceBroker &broker, int depth) {
+  std::string prefix = "g0";
+  for (int level = 1; level <= depth; ++level) {
+    for (int i = 0; i < 8; ++i) {
+      broker.add_service(
+          Service<void, int>(prefix + ".service" + std::to_string(i)));
+    }
+    prefix += ".g" + std::to_string(level);
+  }
+}
+
+struct Left {
+  int id;
+};
+int index(Left const &left) { return left.id; }
+
+struct Right {
+  int id;
+};
+int index(Right const &right) { return right.id; }
+}
+
+// Emission of a service with the given number of slots
+static void BM_ServiceEmit(benchmark::State &state) {
+  Service<int, int> service("service");
+  for (int i = 0; i < state.range(0); ++i) {
+    service.service->connect([i](int a) { return a + i; });
+  }
+  int value = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(service(value++));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ServiceEmit)->Arg(1)->Arg(8)->Arg(64);
+
+static void BM_ServiceEmitVoid(benchmark::State &state) {
+  Service<void, int> service("service");
+  int sum = 0;
+  for (int i = 0; i < state.range(0); ++i) {
+    service.service->connect([&sum](int a) { sum += a; });
+  }
+  for (auto _ : state) {
+    service(1);
+  }
+  benchmark::DoNotOptimize(sum);
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ServiceEmitVoid)->Arg(1)->Arg(8)->Arg(64);
+
+// Emission of boost::signals2::signal and of the lock-free Signal, regardless
+// of the signal used by the services
+template <class SignalType>
+static void BM_SignalEmit(benchmark::State &state) {
+  SignalType signal;
+  for (int i = 0; i < state.range(0); ++i) {
+    signal.connect([i](int a) { return a + i; });
+  }
+  int value = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(signal(value++));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(BM_SignalEmit, boost::signals2::signal<int(int)>)
+    ->Arg(1)
+    ->Arg(8)
+    ->Arg(64);
+BENCHMARK_TEMPLATE(BM_SignalEmit, Signal<int(int)>)->Arg(1)->Arg(8)->Arg(64);
+
+// Emission from several threads at once
+template <class SignalType>
+static void BM_SignalEmitThreaded(benchmark::State &state) {
+  static SignalType *signal = nullptr;
+  if (state.thread_index() == 0) {
+    signal = new SignalType;
+    for (int i = 0; i < 8; ++i) {
+      signal->connect([i](int a) { return a + i; });
+    }
+  }
+  int value = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize((*signal)(value++));
+  }
+  if (state.thread_index() == 0) {
+    delete signal;
+  }
+}
+BENCHMARK_TEMPLATE(BM_SignalEmitThreaded, boost::signals2::signal<int(int)>)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_SignalEmitThreaded, Signal<int(int)>)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+// Call of a group with the given number of services
+static void BM_Call(benchmark::State &state) {
+  ServiceBroker broker;
+  add_group(broker, state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(broker.call<int>("group", 1));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Call)->RangeMultiplier(8)->Range(1, 512);
+
+static void BM_CallCombine(benchmark::State &state) {
+  ServiceBroker broker;
+  add_group(broker, state.range(0));
+  auto sum = [](std::vector<int> const &results) {
+    return std::accumulate(results.begin(), results.end(), 0);
+  };
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(broker.call_combine<int>("group", sum, 1));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CallCombine)->RangeMultiplier(8)->Range(1, 512);
+
+// Same as above with a streaming combiner
+static void BM_CallCombineFold(benchmark::State &state) {
+  ServiceBroker broker;
+  add_group(broker, state.range(0));
+  auto sum = make_fold<int>(0, [](int acc, int result) { return acc + result; });
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(broker.call_combine<int>("group", sum, 1));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CallCombineFold)->RangeMultiplier(8)->Range(1, 512);
+
+// Registration of a callback to every service of a group. Callbacks are
+// disconnected outside of the measured time.
+static void BM_RegisterCallback(benchmark::State &state) {
+  ServiceBroker broker;
+  add_group(broker, state.range(0));
+  for (auto _ : state) {
+    auto connections =
+        broker.register_callback("group", [](int a) { return a; });
+    state.PauseTiming();
+    for (auto &connection : connections) {
+      connection.disconnect();
+    }
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RegisterCallback)->RangeMultiplier(8)->Range(64, 4096);
+
+// Listing of all services of a deep tree
+static void BM_ListServicesDeep(benchmark::State &state) {
+  ServiceBroker broker;
+  add_deep_tree(broker, state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(broker.list_services("g0"));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0) * 8);
+}
+BENCHMARK(BM_ListServicesDeep)->RangeMultiplier(4)->Range(4, 256);
+
+// Listing of the deepest group of a deep tree
+static void BM_ListServicesDeepest(benchmark::State &state) {
+  ServiceBroker broker;
+  add_deep_tree(broker, state.range(0));
+  std::string name = "g0";
+  for (int level = 1; level < state.range(0); ++level) {
+    name += ".g" + std::to_string(level);
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(broker.list_services(name));
+  }
+}
+BENCHMARK(BM_ListServicesDeepest)->RangeMultiplier(4)->Range(4, 256);
+
+// Concatenation of two streams, where every thread puts both halves of its own
+// values and takes any complete value
+static void BM_ConcatPutGet(benchmark::State &state) {
+  static Concat<Left, Right> *concat = nullptr;
+  if (state.thread_index() == 0) {
+    concat = new Concat<Left, Right>;
+  }
+  int id = state.thread_index();
+  std::tuple<Left, Right> result;
+  for (auto _ : state) {
+    concat->put(Left{id});
+    concat->put(Right{id});
+    benchmark::DoNotOptimize(concat->try_get(result));
+    id += state.threads();
+  }
+  if (state.thread_index() == 0) {
+    delete concat;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ConcatPutGet)->ThreadRange(1, 8)->UseRealTime();
+
+BENCHMARK_MAIN();
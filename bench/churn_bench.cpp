@@ -0,0 +1,74 @@
+#include <benchmark/benchmark.h>
+
+#include <communication/ServiceBroker.hpp>
+
+#include <string>
+
+// Service churn caused by short lived workers: every cycle adds and removes
+// the services of a worker with a name never used before. The number of names
+// held by the directory and the lookup time should not depend on the number
+// of cycles.
+
+namespace {
+void fill(ServiceBroker &broker) {
+  for (int i = 0; i < 256; ++i) {
+    Service<void, int> service("module" + std::to_string(i / 16) +
+                               ".service" + std::to_string(i % 16));
+    service.service->connect([](int) {});
+    broker.add_service(service);
+  }
+}
+
+void cycle(ServiceBroker &broker, std::size_t connection) {
+  auto prefix = "connection." + std::to_string(connection);
+  Service<void, int> input(prefix + ".input");
+  Service<void, int> output(prefix + ".output");
+  broker.add_service(input);
+  broker.add_service(output);
+  broker.remove_service(prefix);
+}
+}
+
+// Add and remove the services of one worker
+static void BM_Cycle(benchmark::State &state) {
+  ServiceBroker broker;
+  fill(broker);
+  std::size_t connection = 0;
+  for (auto _ : state) {
+    cycle(broker, connection++);
+  }
+  state.counters["cycles"] = static_cast<double>(connection);
+  state.counters["names"] =
+      static_cast<double>(broker.capacity());
+}
+BENCHMARK(BM_Cycle);
+
+// Group call after the given number of cycles
+static void BM_CallAfterChurn(benchmark::State &state) {
+  ServiceBroker broker;
+  fill(broker);
+  for (std::size_t i = 0; i < static_cast<std::size_t>(state.range(0)); ++i) {
+    cycle(broker, i);
+  }
+  for (auto _ : state) {
+    broker.call<void>("module0", 1);
+  }
+  state.counters["names"] =
+      static_cast<double>(broker.capacity());
+}
+BENCHMARK(BM_CallAfterChurn)->RangeMultiplier(32)->Range(1, 1 << 20);
+
+// Listing of all services after the given number of cycles
+static void BM_ListAfterChurn(benchmark::State &state) {
+  ServiceBroker broker;
+  fill(broker);
+  for (std::size_t i = 0; i < static_cast<std::size_t>(state.range(0)); ++i) {
+    cycle(broker, i);
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(broker.list_services());
+  }
+}
+BENCHMARK(BM_ListAfterChurn)->RangeMultiplier(32)->Range(1, 1 << 20);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,96 @@
+#include <benchmark/benchmark.h>
+
+#include <communication/ServiceBroker.hpp>
+#include <communication/ConcurrentServiceBroker.hpp>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace {
+// ServiceBroker made thread-safe with a single mutex, for comparison.
+class LockedServiceBroker {
+ public:
+  template <typename Result, typename... Args>
+  void add_service(Service<Result, Args...> service) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    broker_.add_service(service);
+  }
+
+  std::size_t remove_service(std::string const &name) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return broker_.remove_service(name);
+  }
+
+  template <typename ResultType, typename... Args>
+  decltype(auto) call(std::string const &name, Args &&... args) const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return broker_.call<ResultType>(name, std::forward<Args>(args)...);
+  }
+
+ private:
+  ServiceBroker broker_;
+  mutable std::mutex mtx_;
+};
+
+// Broker with a group of services and a thread which continuously adds and
+// removes services from the same group.
+template <typename Broker>
+struct ChurningBroker {
+  ChurningBroker() {
+    for (int i = 0; i < 8; ++i) {
+      Service<int, int> service("group.service" + std::to_string(i));
+      service.service->connect([](int a) { return a + 1; });
+      broker.add_service(service);
+    }
+    churn = std::thread([this]() {
+      for (int i = 0; !stop; ++i) {
+        auto name = "group.churn" + std::to_string(i % 16);
+        broker.add_service(Service<int, int>(name));
+        broker.remove_service(name);
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+    });
+  }
+
+  ~ChurningBroker() {
+    stop = true;
+    churn.join();
+  }
+
+  Broker broker;
+  std::atomic<bool> stop{false};
+  std::thread churn;
+};
+
+template <typename Broker>
+std::unique_ptr<ChurningBroker<Broker>> &churning_broker() {
+  static std::unique_ptr<ChurningBroker<Broker>> broker;
+  return broker;
+}
+}
+
+// Call throughput of a single service while services are being added to and
+// removed from the broker.
+template <typename Broker>
+static void BM_CallWhileChurning(benchmark::State &state) {
+  auto &fixture = churning_broker<Broker>();
+  if (state.thread_index() == 0) {
+    fixture.reset(new ChurningBroker<Broker>());
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        fixture->broker.template call<int>("group.service0", 1));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_CallWhileChurning, LockedServiceBroker)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_CallWhileChurning, ConcurrentServiceBroker)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,63 @@
+#include <benchmark/benchmark.h>
+
+#include <communication/ServiceBroker.hpp>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+// Group call with members of uneven latency: every eighth member takes 2 ms,
+// the others 100 us. Sequential call takes the sum of the latencies, while
+// parallel call takes roughly the sum divided by the number of threads.
+
+namespace {
+void add_services(ServiceBroker &broker, int nservices) {
+  for (int i = 0; i < nservices; ++i) {
+    Service<int, int> service("group.service" + std::to_string(i));
+    auto latency = std::chrono::microseconds(i % 8 == 0 ? 2000 : 100);
+    service.service->connect([latency](int a) {
+      std::this_thread::sleep_for(latency);
+      return a;
+    });
+    broker.add_service(service);
+  }
+}
+
+void setup(ServiceBroker &broker, benchmark::State &state) {
+  add_services(broker, static_cast<int>(state.range(0)));
+  broker.set_executor(std::make_shared<Executor>(8));
+}
+}
+
+static void BM_Call(benchmark::State &state) {
+  ServiceBroker broker;
+  setup(broker, state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(broker.call<int>("group", 1));
+  }
+}
+BENCHMARK(BM_Call)->RangeMultiplier(4)->Range(4, 64)->UseRealTime();
+
+static void BM_CallParallel(benchmark::State &state) {
+  ServiceBroker broker;
+  setup(broker, state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(broker.call_parallel<int>("group", 1));
+  }
+}
+BENCHMARK(BM_CallParallel)->RangeMultiplier(4)->Range(4, 64)->UseRealTime();
+
+static void BM_CallReduceParallel(benchmark::State &state) {
+  ServiceBroker broker;
+  setup(broker, state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(broker.call_reduce_parallel<int>(
+        "group", 0, [](int acc, int result) { return acc + result; }, 1));
+  }
+}
+BENCHMARK(BM_CallReduceParallel)
+    ->RangeMultiplier(4)
+    ->Range(4, 64)
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
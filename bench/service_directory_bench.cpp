@@ -0,0 +1,72 @@
+#include <benchmark/benchmark.h>
+
+#include <communication/ServiceBroker.hpp>
+
+#include <string>
+
+namespace {
+// Fill the directory with the given number of services, split into groups of
+// 16 services: "module<i>.group<j>.service<k>".
+void fill(ServiceDirectory &directory, int nservices) {
+  for (int i = 0; i < nservices; ++i) {
+    directory.add_service("module" + std::to_string(i / 256) + ".group" +
+                          std::to_string(i / 16 % 16) + ".service" +
+                          std::to_string(i % 16));
+  }
+}
+}
+
+// Lookup of a single group, which should not depend on the directory size.
+static void BM_ListGroup(benchmark::State &state) {
+  ServiceDirectory directory;
+  fill(directory, state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(directory.list_services("module0.group0"));
+  }
+}
+BENCHMARK(BM_ListGroup)->RangeMultiplier(4)->Range(16, 1 << 16);
+
+// Same as above without copying the list of the names.
+static void BM_ServicesGroup(benchmark::State &state) {
+  ServiceDirectory directory;
+  fill(directory, state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(&directory.services("module0.group0"));
+  }
+}
+BENCHMARK(BM_ServicesGroup)->RangeMultiplier(4)->Range(16, 1 << 16);
+
+// Lookup of a single service
+static void BM_ListService(benchmark::State &state) {
+  ServiceDirectory directory;
+  fill(directory, state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        directory.list_services("module0.group0.service0"));
+  }
+}
+BENCHMARK(BM_ListService)->RangeMultiplier(4)->Range(16, 1 << 16);
+
+// Listing of all services copies all the names.
+static void BM_ListAll(benchmark::State &state) {
+  ServiceDirectory directory;
+  fill(directory, state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(directory.list_services());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ListAll)->RangeMultiplier(4)->Range(16, 1 << 16);
+
+// Add and remove a service in a populated directory
+static void BM_AddRemove(benchmark::State &state) {
+  ServiceDirectory directory;
+  fill(directory, state.range(0));
+  for (auto _ : state) {
+    directory.add_service("module0.group0.extra");
+    directory.remove_service("module0.group0.extra");
+  }
+}
+BENCHMARK(BM_AddRemove)->RangeMultiplier(4)->Range(16, 1 << 16);
+
+BENCHMARK_MAIN();
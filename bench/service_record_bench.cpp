@@ -0,0 +1,96 @@
+#include <benchmark/benchmark.h>
+
+#include <communication/ServiceBroker.hpp>
+
+#include <boost/any.hpp>
+
+#include <string>
+#include <unordered_map>
+
+// Compares the service storage used by the broker (detail::service_record)
+// with the storage in boost::any and any_cast, which was used before.
+
+namespace {
+using service_type = Service<int, int>;
+
+service_type make_service() {
+  service_type service("group.service");
+  service.service->connect([](int a) { return a + 1; });
+  return service;
+}
+}
+
+static void BM_AnyCall(benchmark::State &state) {
+  std::unordered_map<std::string, boost::any> services;
+  services.emplace("group.service", make_service());
+  const std::string name = "group.service";
+  for (auto _ : state) {
+    auto it = services.find(name);
+    try {
+      benchmark::DoNotOptimize(boost::any_cast<service_type>(it->second)(1));
+    } catch (boost::bad_any_cast &) {
+    }
+  }
+}
+BENCHMARK(BM_AnyCall);
+
+static void BM_RecordCall(benchmark::State &state) {
+  std::unordered_map<std::string, detail::service_record> services;
+  services.emplace("group.service", detail::service_record(make_service()));
+  const std::string name = "group.service";
+  for (auto _ : state) {
+    auto it = services.find(name);
+    if (auto service = it->second.get<service_type>()) {
+      benchmark::DoNotOptimize((*service)(1));
+    }
+  }
+}
+BENCHMARK(BM_RecordCall);
+
+static void BM_AnyMismatch(benchmark::State &state) {
+  std::unordered_map<std::string, boost::any> services;
+  services.emplace("group.service", make_service());
+  const std::string name = "group.service";
+  for (auto _ : state) {
+    auto it = services.find(name);
+    try {
+      boost::any_cast<Service<int, double>>(it->second)(1.);
+    } catch (boost::bad_any_cast &e) {
+      benchmark::DoNotOptimize(&e);
+    }
+  }
+}
+BENCHMARK(BM_AnyMismatch);
+
+static void BM_RecordMismatch(benchmark::State &state) {
+  std::unordered_map<std::string, detail::service_record> services;
+  services.emplace("group.service", detail::service_record(make_service()));
+  const std::string name = "group.service";
+  for (auto _ : state) {
+    auto it = services.find(name);
+    benchmark::DoNotOptimize(it->second.get<Service<int, double>>());
+  }
+}
+BENCHMARK(BM_RecordMismatch);
+
+// Complete broker call, including the directory lookup
+static void BM_BrokerCall(benchmark::State &state) {
+  ServiceBroker broker;
+  broker.add_service(make_service());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(broker.call<int>("group.service", 1));
+  }
+}
+BENCHMARK(BM_BrokerCall);
+
+static void BM_BrokerFindService(benchmark::State &state) {
+  ServiceBroker broker;
+  broker.add_service(make_service());
+  const std::string name = "group.service";
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(broker.find_service<int, double>(name));
+  }
+}
+BENCHMARK(BM_BrokerFindService);
+
+BENCHMARK_MAIN();
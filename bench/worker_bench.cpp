@@ -0,0 +1,275 @@
+#include <benchmark/benchmark.h>
+
+#include <communication/Workers.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <string>
+#include <thread>
+
+// Latency of a single hop through WorkerMultiThreaded: a task is emitted on
+// the input service and the benchmark waits for the result. PollingWorker
+// reproduces the former loop of WorkerMultiThreaded, which polled both queues
+// and slept for 50 us in between.
+//
+// BM_SkewedLatency sends bursts of tasks, where every sixteenth task takes
+// 2 ms and the others 50 us, and reports the median and the 99th percentile
+// of the time from sending a task to receiving its result, with the results
+// in the order of scheduling (ordered:1) and of completion (ordered:0).
+//
+// BM_WorkerChain sends bursts of tasks through a chain of single-threaded
+// workers, each with its own thread (BM_WorkerChain<DedicatedThreads>) or all
+// of them on the shared executor (BM_WorkerChain<SharedScheduler>).
+//
+// BM_FusedChain sends bursts of tasks through a pipeline of five
+// single-threaded workers, with the chain fused onto the thread of its first
+// worker (fused:1) or with a queue per hop (fused:0).
+
+namespace {
+struct IdentityContext : ContextBase<int, int> {
+  int run(int const &arg) override { return arg; }
+};
+
+class Worker : public WorkerMultiThreaded<int, int, IdentityContext> {
+  using Base = WorkerMultiThreaded<int, int, IdentityContext>;
+
+ public:
+  using Base::Base;
+
+ protected:
+  void preprocess(int const &arg) override { schedule(arg); }
+  int postprocess(int &&arg) override { return arg; }
+};
+
+struct SkewedContext : ContextBase<int, int> {
+  int run(int const &arg) override {
+    std::this_thread::sleep_for(
+        std::chrono::microseconds(arg % 16 == 0 ? 2000 : 50));
+    return arg;
+  }
+};
+
+class SkewedWorker : public WorkerMultiThreaded<int, int, SkewedContext> {
+  using Base = WorkerMultiThreaded<int, int, SkewedContext>;
+
+ public:
+  using Base::Base;
+
+ protected:
+  void preprocess(int const &arg) override { schedule(arg); }
+  int postprocess(int &&arg) override { return arg; }
+};
+
+template <typename ThreadingPolicy>
+class ChainWorker : public WorkerSingleThreaded<int, int, ThreadingPolicy> {
+  using Base = WorkerSingleThreaded<int, int, ThreadingPolicy>;
+
+ public:
+  using Base::Base;
+
+ protected:
+  int run(int const &arg) override { return arg; }
+};
+
+class PollingWorker {
+ public:
+  PollingWorker() : executors_(options()), terminate_(false) {
+    thread_ = std::thread([this]() { run_(); });
+  }
+
+  ~PollingWorker() {
+    terminate_ = true;
+    thread_.join();
+  }
+
+  Service<void, int> result_signal = {"polling.result"};
+  threaded_queue<int> task_queue_;
+
+ private:
+  void run_() {
+    while (!terminate_) {
+      int task;
+      if (task_queue_.try_pull_front(task) == queue_op_status::success) {
+        executors_.schedule_task(task);
+      }
+      ScheduledResult<int> result;
+      if (executors_.result_queue.try_pull_front(result) ==
+          queue_op_status::success) {
+        result_signal(result.value.get());
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+
+  static ExecutorOptions options() {
+    ExecutorOptions options;
+    options.executors = 4;
+    return options;
+  }
+
+  ContextExecutor<IdentityContext> executors_;
+  std::atomic<bool> terminate_;
+  std::thread thread_;
+};
+
+void wait_for(std::atomic<int> const &received, int expected) {
+  while (received.load(std::memory_order_acquire) != expected) {
+    std::this_thread::yield();
+  }
+}
+}
+
+static void BM_WorkerHop(benchmark::State &state) {
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("input");
+  Worker worker("worker", broker, input);
+  std::atomic<int> received{0};
+  worker.result_signal.service->connect(
+      [&received](int) { received.fetch_add(1, std::memory_order_release); });
+
+  int sent = 0;
+  for (auto _ : state) {
+    input.emit(int{sent});
+    wait_for(received, ++sent);
+  }
+}
+BENCHMARK(BM_WorkerHop)->UseRealTime();
+
+static void BM_PollingWorkerHop(benchmark::State &state) {
+  PollingWorker worker;
+  std::atomic<int> received{0};
+  worker.result_signal.service->connect(
+      [&received](int) { received.fetch_add(1, std::memory_order_release); });
+
+  int sent = 0;
+  for (auto _ : state) {
+    worker.task_queue_.push_back(sent);
+    wait_for(received, ++sent);
+  }
+}
+BENCHMARK(BM_PollingWorkerHop)->UseRealTime();
+
+static void BM_SkewedLatency(benchmark::State &state) {
+  using clock = std::chrono::steady_clock;
+  const int burst = 64;
+
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("input");
+  ExecutorOptions options;
+  options.executors = 4;
+  options.ordered = state.range(0) != 0;
+  SkewedWorker worker("worker", broker, input);
+  worker.set_executor_options(options);
+
+  std::vector<clock::time_point> sent(burst);
+  std::vector<double> latencies;
+  std::mutex mtx;
+  std::atomic<int> received{0};
+  worker.result_signal.service->connect([&](int task) {
+    auto latency = clock::now() - sent[task % burst];
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      latencies.push_back(
+          std::chrono::duration<double, std::micro>(latency).count());
+    }
+    received.fetch_add(1, std::memory_order_release);
+  });
+
+  int total = 0;
+  for (auto _ : state) {
+    for (int i = 0; i < burst; ++i) {
+      sent[i] = clock::now();
+      input.emit(int{total + i});
+    }
+    total += burst;
+    wait_for(received, total);
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  state.counters["p50_us"] = latencies[latencies.size() / 2];
+  state.counters["p99_us"] = latencies[latencies.size() * 99 / 100];
+}
+BENCHMARK(BM_SkewedLatency)->ArgName("ordered")->Arg(1)->Arg(0)->UseRealTime();
+
+template <typename ThreadingPolicy>
+static void BM_WorkerChain(benchmark::State &state) {
+  const int burst = 64;
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("input");
+  std::vector<std::unique_ptr<ChainWorker<ThreadingPolicy>>> chain;
+  chain.emplace_back(new ChainWorker<ThreadingPolicy>("w0", broker, input));
+  for (int i = 1; i < state.range(0); ++i) {
+    std::vector<std::string> const inputs{"w" + std::to_string(i - 1)};
+    chain.emplace_back(new ChainWorker<ThreadingPolicy>(
+        "w" + std::to_string(i), broker, inputs));
+  }
+  std::atomic<int> received{0};
+  chain.back()->result_signal.service->connect(
+      [&received](int) { received.fetch_add(1, std::memory_order_release); });
+
+  int total = 0;
+  for (auto _ : state) {
+    for (int i = 0; i < burst; ++i) {
+      input.emit(int{total + i});
+    }
+    total += burst;
+    wait_for(received, total);
+  }
+  state.SetItemsProcessed(total);
+}
+BENCHMARK_TEMPLATE(BM_WorkerChain, DedicatedThreads)
+    ->ArgName("workers")->Arg(8)->Arg(200)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_WorkerChain, SharedScheduler)
+    ->ArgName("workers")->Arg(8)->Arg(200)->UseRealTime();
+
+template <typename ThreadingPolicy>
+static void BM_FusedChain(benchmark::State &state) {
+  const int burst = 64;
+  const int stages = 5;
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("source.result");
+  broker->add_service(input);
+  Pipeline pipeline(broker);
+  pipeline.add<ChainWorker<ThreadingPolicy>>("w0", {"source"});
+  for (int i = 1; i < stages; ++i) {
+    pipeline.add<ChainWorker<ThreadingPolicy>>("w" + std::to_string(i),
+                                               {"w" + std::to_string(i - 1)});
+  }
+  std::atomic<int> received{0};
+  broker->register_callback(
+      "w" + std::to_string(stages - 1) + ".result",
+      [&received](int) { received.fetch_add(1, std::memory_order_release); });
+  if (state.range(0)) {
+    pipeline.fuse();
+  }
+
+  int total = 0;
+  for (auto _ : state) {
+    for (int i = 0; i < burst; ++i) {
+      input.emit(int{total + i});
+    }
+    total += burst;
+    wait_for(received, total);
+  }
+  state.SetItemsProcessed(total);
+}
+BENCHMARK_TEMPLATE(BM_FusedChain, DedicatedThreads)
+    ->ArgName("fused")->Arg(0)->Arg(1)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_FusedChain, SharedScheduler)
+    ->ArgName("fused")->Arg(0)->Arg(1)->UseRealTime();
+
+// Cost of recording a latency from several threads into one histogram
+static void BM_LatencyHistogramRecord(benchmark::State &state) {
+  static LatencyHistogram histogram;
+  std::chrono::nanoseconds latency(1000);
+  for (auto _ : state) {
+    histogram.record(latency);
+  }
+}
+BENCHMARK(BM_LatencyHistogramRecord)->Threads(1)->Threads(4);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,220 @@
+#ifndef AFFINITY_HPP
+#define AFFINITY_HPP
+
+#pragma once
+
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/** Where the threads of a worker run. Threads are pinned to the CPUs and
+ * allocate their memory on the NUMA node. Placement is applied on Linux only
+ * and ignored elsewhere. */
+struct Placement {
+  // CPUs the threads may run on, any CPU if empty
+  std::vector<unsigned> cpus;
+  // NUMA node of the threads and their memory, -1 for any node. Threads run
+  // on the CPUs of the node, unless the cpus are set.
+  int numa_node = -1;
+
+  bool empty() const { return cpus.empty() && numa_node < 0; }
+};
+
+/** Where a thread runs. */
+struct ThreadPlacement {
+  // Worker's name and the role of the thread, e.g. "worker.executor.0"
+  std::string name;
+  // Thread id of the operating system
+  long thread_id = 0;
+  // CPUs the thread may run on
+  std::vector<unsigned> cpus;
+  // CPU the thread ran on last, -1 if unknown
+  int cpu = -1;
+  // NUMA node of the CPU, -1 if unknown
+  int numa_node = -1;
+};
+
+namespace affinity {
+namespace detail {
+// Parse a CPU list of the kernel, e.g. "0-3,8,10-11"
+inline std::vector<unsigned> parse_cpu_list(std::string const &list) {
+  std::vector<unsigned> cpus;
+  std::istringstream in(list);
+  std::string range;
+  while (std::getline(in, range, ',')) {
+    if (range.empty() || range == "\n") {
+      continue;
+    }
+    auto dash = range.find('-');
+    unsigned first = std::stoul(range.substr(0, dash));
+    unsigned last =
+        dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+    for (auto cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+}
+
+// CPUs of the NUMA node, empty if unknown
+inline std::vector<unsigned> node_cpus(int node) {
+  std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) +
+                   "/cpulist");
+  std::string list;
+  std::getline(in, list);
+  return detail::parse_cpu_list(list);
+}
+
+// NUMA node of the CPU, -1 if unknown
+inline int cpu_node(int cpu) {
+  if (cpu < 0) {
+    return -1;
+  }
+  for (int node = 0;; ++node) {
+    std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) +
+                     "/cpulist");
+    if (!in) {
+      return -1;
+    }
+    std::string list;
+    std::getline(in, list);
+    for (auto node_cpu : detail::parse_cpu_list(list)) {
+      if (static_cast<int>(node_cpu) == cpu) {
+        return node;
+      }
+    }
+  }
+}
+
+// Thread id of the calling thread, 0 if unknown
+inline long current_thread_id() {
+#ifdef __linux__
+  return static_cast<long>(::syscall(SYS_gettid));
+#else
+  return 0;
+#endif
+}
+
+#ifdef __linux__
+namespace detail {
+inline bool pin(pthread_t thread, Placement const &placement) {
+  auto cpus = placement.cpus.empty() ? node_cpus(placement.numa_node)
+                                     : placement.cpus;
+  if (cpus.empty()) {
+    return true;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto cpu : cpus) {
+    if (cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  return ::pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+}
+#endif
+
+// Pin the thread to the CPUs of the placement. Memory of the thread is
+// placed by apply only. Returns false if the thread could not be pinned.
+inline bool pin(std::thread &thread, Placement const &placement) {
+#ifdef __linux__
+  return placement.empty() || detail::pin(thread.native_handle(), placement);
+#else
+  return placement.empty();
+#endif
+}
+
+// Pin the calling thread and prefer the memory of its node. Returns false if
+// the placement could not be applied.
+inline bool apply(Placement const &placement) {
+#ifdef __linux__
+  if (placement.empty()) {
+    return true;
+  }
+  bool applied = detail::pin(::pthread_self(), placement);
+  if (placement.numa_node >= 0 && placement.numa_node < 64) {
+    // MPOL_PREFERRED of <linux/mempolicy.h>. Memory is allocated on the node
+    // while it has free pages.
+    const int preferred = 1;
+    unsigned long nodes = 1ul << placement.numa_node;
+    applied = ::syscall(SYS_set_mempolicy, preferred, &nodes,
+                        8 * sizeof(nodes)) == 0 &&
+              applied;
+  }
+  return applied;
+#else
+  return placement.empty();
+#endif
+}
+
+// Where the thread with the given id runs
+inline ThreadPlacement describe(std::string name, long thread_id) {
+  ThreadPlacement placement;
+  placement.name = std::move(name);
+  placement.thread_id = thread_id;
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (thread_id != 0 &&
+      ::sched_getaffinity(static_cast<pid_t>(thread_id), sizeof(set), &set) ==
+          0) {
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) {
+        placement.cpus.push_back(cpu);
+      }
+    }
+  }
+  // Processor is the 39th field of the stat file, after the command name in
+  // parentheses
+  std::ifstream in("/proc/self/task/" + std::to_string(thread_id) + "/stat");
+  std::string stat;
+  std::getline(in, stat);
+  auto end_of_name = stat.rfind(')');
+  if (end_of_name != std::string::npos) {
+    std::istringstream fields(stat.substr(end_of_name + 2));
+    std::string field;
+    for (int i = 3; i <= 39 && fields >> field; ++i) {
+      if (i == 39) {
+        placement.cpu = std::stoi(field);
+      }
+    }
+  }
+  placement.numa_node = cpu_node(placement.cpu);
+#endif
+  return placement;
+}
+}
+
+inline std::ostream &operator<<(std::ostream &out,
+                                ThreadPlacement const &placement) {
+  out << placement.name << ": thread " << placement.thread_id << ", cpu "
+      << placement.cpu << ", node " << placement.numa_node << ", cpus ";
+  for (std::size_t i = 0; i < placement.cpus.size(); ++i) {
+    out << (i == 0 ? "" : ",") << placement.cpus[i];
+  }
+  return out;
+}
+
+// One line per thread
+inline std::string topology_report(
+    std::vector<ThreadPlacement> const &threads) {
+  std::ostringstream out;
+  for (auto const &thread : threads) {
+    out << thread << '\n';
+  }
+  return out.str();
+}
+
+#endif
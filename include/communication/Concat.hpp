@@ -9,7 +9,10 @@
 #include <iostream>
 #include <mutex>
 #include <array>
+#include <cassert>
+#include <chrono>
 #include <numeric>
+#include <tuple>
 
 #include <threadpool/ThreadedQueue.hpp>
 
@@ -121,12 +124,14 @@ class ConcatImpl {
 
     // If all the elements are present in the concatenated object, add it to the
     // output queue.
-    if (complete_function().operator() < T, Args... > (element_it->second)) {
+    if (complete_function().template operator()<T, Args...>(
+            element_it->second)) {
       output_queue_.push_back(std::get<2>(element_it->second));
     }
 
     // Should we delete the complete or incomplete element from the storage?
-    if (erase_function().operator() < T, Args... > (element_it->second)) {
+    if (erase_function().template operator()<T, Args...>(
+            element_it->second)) {
       data_.erase(element_it);
     }
   }
@@ -0,0 +1,212 @@
+#ifndef CONCURRENT_SERVICE_BROKER_HPP
+#define CONCURRENT_SERVICE_BROKER_HPP
+
+#include <mutex>
+#include <memory>
+
+#include "ServiceBroker.hpp"
+#include "ServiceHandle.hpp"
+#include "detail/epoch.hpp"
+
+/** A thread-safe service broker. ConcurrentServiceBroker provides the same
+ * interface as ServiceBroker and can be used as BrokerType of the workers.
+ * Services are stored in an immutable snapshot. Calls and lookups read the
+ * current snapshot without taking any lock. Modifications are serialized:
+ * each modification copies the current snapshot, modifies the copy and
+ * publishes it, while the old snapshot is deleted once no reader uses it
+ * anymore. Adding and removing services is therefore much more expensive than
+ * with ServiceBroker. */
+class ConcurrentServiceBroker {
+ public:
+  ConcurrentServiceBroker()
+      : snapshot_(std::unique_ptr<ServiceBroker>(new ServiceBroker)) {}
+
+  /**
+   Add a service.
+
+   @exception broker_error Thrown when a service with the same name
+   already exists.
+   */
+  template <typename Result, typename... Args>
+  void add_service(Service<Result, Args...> service) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    auto next = copy();
+    next->add_service(service);
+    snapshot_.store(std::move(next));
+  }
+
+  /**
+   Remove a service or a group of services.
+
+   @return Number of removed services.
+   */
+  std::size_t remove_service(NameRef name) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    auto next = copy();
+    auto count = next->remove_service(name);
+    snapshot_.store(std::move(next));
+    return count;
+  }
+
+  /**
+   Register callback to all services in a group.
+
+   @exception broker_error Thrown when no service matches the name or when
+   the types do not match.
+   */
+  template <typename Function>
+  std::vector<Connection> register_callback(
+      NameRef name, Function &&callback) const {
+    detail::epoch_guard guard;
+    return snapshot_.load()->register_callback(
+        name, std::forward<Function>(callback));
+  }
+
+  // Register callback to be called through its own mailbox. See
+  // ServiceBroker::register_callback.
+  template <typename Function>
+  std::vector<Connection> register_callback(NameRef name, Function &&callback,
+                                            DispatchPolicy policy) const {
+    detail::epoch_guard guard;
+    return snapshot_.load()->register_callback(
+        name, std::forward<Function>(callback), std::move(policy));
+  }
+
+  /// @brief Call all services inside the directory 'name'. See
+  /// ServiceBroker::call.
+  template <typename ResultType, typename... Args>
+  decltype(auto) call(NameRef name, Args &&... args) const {
+    detail::epoch_guard guard;
+    return snapshot_.load()->template call<ResultType, Args...>(
+        name, std::forward<Args>(args)...);
+  }
+
+  /// @brief Call all services inside the directory 'name' and combine the
+  /// results. See ServiceBroker::call_combine.
+  template <typename ResultType, class Combiner, typename... Args>
+  decltype(auto) call_combine(NameRef name, Combiner &&combiner,
+                              Args &&... args) const {
+    detail::epoch_guard guard;
+    return snapshot_.load()->template call_combine<ResultType>(
+        name, std::forward<Combiner>(combiner), std::forward<Args>(args)...);
+  }
+
+  /// @brief Call all services inside the directory 'name' asynchronously. See
+  /// ServiceBroker::call_async.
+  template <typename ResultType, typename... Args>
+  decltype(auto) call_async(NameRef name, Args &&... args) const {
+    detail::epoch_guard guard;
+    return snapshot_.load()->template call_async<ResultType, Args...>(
+        name, std::forward<Args>(args)...);
+  }
+
+  /// @brief Call all services inside the directory 'name' in parallel. See
+  /// ServiceBroker::call_parallel.
+  template <typename ResultType, typename... Args>
+  decltype(auto) call_parallel(NameRef name, Args &&... args) const {
+    detail::epoch_guard guard;
+    return snapshot_.load()->template call_parallel<ResultType, Args...>(
+        name, std::forward<Args>(args)...);
+  }
+
+  /// @brief See ServiceBroker::call_combine_parallel.
+  template <typename ResultType, class Combiner, typename... Args>
+  decltype(auto) call_combine_parallel(NameRef name, Combiner &&combiner,
+                                       Args &&... args) const {
+    detail::epoch_guard guard;
+    return snapshot_.load()->template call_combine_parallel<ResultType>(
+        name, std::forward<Combiner>(combiner), std::forward<Args>(args)...);
+  }
+
+  /// @brief See ServiceBroker::call_reduce_parallel.
+  template <typename ResultType, typename Accumulator, class Reduce,
+            typename... Args>
+  Accumulator call_reduce_parallel(NameRef name, Accumulator initial,
+                                   Reduce &&reduce, Args &&... args) const {
+    detail::epoch_guard guard;
+    return snapshot_.load()->template call_reduce_parallel<ResultType>(
+        name, std::move(initial), std::forward<Reduce>(reduce),
+        std::forward<Args>(args)...);
+  }
+
+  void set_executor(std::shared_ptr<Executor> executor) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    auto next = copy();
+    next->set_executor(std::move(executor));
+    snapshot_.store(std::move(next));
+  }
+
+  /**
+   Get a service.
+
+   @exception broker_error Thrown when a service with required name does not
+   exist or when the types do not match.
+   */
+  template <typename Result, typename... Args>
+  Service<Result, Args...> get_service(NameRef name) const {
+    detail::epoch_guard guard;
+    return snapshot_.load()->template get_service<Result, Args...>(name);
+  }
+
+  std::vector<std::string> list_services(NameRef name = "") const {
+    detail::epoch_guard guard;
+    return snapshot_.load()->list_services(name);
+  }
+
+  /// @brief Get the symbol of a service or group. See ServiceBroker::symbol.
+  boost::optional<Symbol> symbol(NameRef name) const {
+    detail::epoch_guard guard;
+    return snapshot_.load()->symbol(name);
+  }
+
+  // Return the name of the symbol
+  std::string name(Symbol symbol) const {
+    detail::epoch_guard guard;
+    return snapshot_.load()->name(symbol);
+  }
+
+  /// @brief Resolve all services inside the directory 'name' to a handle. See
+  /// ServiceBroker::resolve.
+  template <typename ResultType, typename... Args>
+  ServiceHandleT<ConcurrentServiceBroker, ResultType, Args...> resolve(
+      NameRef name) {
+    return {*this, name};
+  }
+
+  template <typename ResultType, typename... Args>
+  std::vector<Service<ResultType, Args...>> resolve_services(
+      NameRef name) const {
+    detail::epoch_guard guard;
+    return snapshot_.load()->template resolve_services<ResultType, Args...>(
+        name);
+  }
+
+  std::size_t generation() const noexcept {
+    detail::epoch_guard guard;
+    return snapshot_.load()->generation();
+  }
+
+  /**
+   Clear all services
+   */
+  void clear() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    auto next = copy();
+    next->clear();
+    snapshot_.store(std::move(next));
+  }
+
+ private:
+  // Copy of the current snapshot. Must be called with mtx_ locked, since only
+  // writers replace (and retire) the snapshot.
+  std::unique_ptr<ServiceBroker> copy() const {
+    return std::unique_ptr<ServiceBroker>(new ServiceBroker(*snapshot_.load()));
+  }
+
+  // Current snapshot
+  detail::rcu_ptr<ServiceBroker> snapshot_;
+  // Serializes modifications
+  std::mutex mtx_;
+};
+
+#endif
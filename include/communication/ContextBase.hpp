@@ -1,8 +1,10 @@
 #ifndef CONTEXT_BASE_HPP
 #define CONTEXT_BASE_HPP
 
-#include <mutex>
-#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "detail/snapshot.hpp"
 
 template <typename ArgumentType, typename ResultType,
           typename ConfigurationType>
@@ -11,56 +13,61 @@ public:
   using argument_type = ArgumentType;
   using result_type = ResultType;
   using configuration_type = ConfigurationType;
+  using configuration_snapshot = detail::snapshot<configuration_type>;
 
 public:
-  ContextBaseT() : configuration_changed_(false) {}
+  ContextBaseT()
+      : configuration_(std::make_shared<configuration_snapshot>()),
+        current_(configuration_->load()), version_(0) {}
 
   result_type operator()(argument_type const &arg) {
-    if (configuration_changed_) {
-      std::unique_lock<std::mutex> storage_lock(configuration_storage_mtx_,
-                                                std::defer_lock);
-      std::unique_lock<std::mutex> configuration_lock(configuration_mtx_,
-                                                      std::defer_lock);
-      std::lock(storage_lock, configuration_lock);
-      set_configuration_(configuration_storage_);
-      configuration_changed_ = false;
-    }
-
-    std::lock_guard<std::mutex> configuration_lock(configuration_mtx_);
+    update_configuration();
     return run(arg);
   }
 
   virtual result_type run(argument_type const &) = 0;
 
+  // Publish the configuration. Context switches to it before the next call.
   void set_configuration(configuration_type const &configuration) {
-    // Set temporary configuration storage
-    std::lock_guard<std::mutex> storage_lock(configuration_storage_mtx_);
-    configuration_storage_ = configuration;
+    configuration_->store(
+        std::make_shared<configuration_type const>(configuration));
+  }
 
-    // Check if we can update configuration immediately
-    std::unique_lock<std::mutex> configuration_lock(configuration_mtx_,
-                                                    std::try_to_lock_t());
-    if (configuration_lock.owns_lock()) {
-      // Immediately set configuration
-      set_configuration_(configuration);
-    } else {
-      // Defer configuration change
-      configuration_changed_ = true;
-    }
+  // Read the configuration from the snapshots, e.g. of the worker, instead of
+  // its own. Must be called before the context is used.
+  void share_configuration(std::shared_ptr<configuration_snapshot> snapshot) {
+    configuration_ = std::move(snapshot);
+    current_ = configuration_->load();
+    version_ = 0;
   }
 
   configuration_type get_configuration() const { return get_configuration_(); }
 
 protected:
+  // Configuration of the current call. Does not change during the call.
+  configuration_type const &configuration() const { return *current_; }
+
+  // Called on the thread of the context before the first call after a
+  // configuration change
   virtual void set_configuration_(configuration_type const &configuration) {}
   virtual configuration_type get_configuration_() const {
-    return configuration_storage_;
+    return *configuration_->load();
   }
 
 private:
-  std::mutex configuration_mtx_;
-  std::mutex configuration_storage_mtx_;
-  std::atomic<bool> configuration_changed_;
-  configuration_type configuration_storage_;
+  // Switch to the latest snapshot. Costs a single load if it is unchanged.
+  void update_configuration() {
+    auto version = configuration_->version();
+    if (version != version_) {
+      version_ = version;
+      current_ = configuration_->load();
+      set_configuration_(*current_);
+    }
+  }
+
+  std::shared_ptr<configuration_snapshot> configuration_;
+  // Snapshot used by the calls and its version
+  std::shared_ptr<configuration_type const> current_;
+  std::uint64_t version_;
 };
 #endif
@@ -0,0 +1,455 @@
+#ifndef CONTEXT_EXECUTOR_HPP
+#define CONTEXT_EXECUTOR_HPP
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <vector>
+
+#include <threadpool/PerformanceStatistics.hpp>
+#include <threadpool/ThreadedQueue.hpp>
+
+#include "Affinity.hpp"
+#include "Executor.hpp"
+#include "Tracing.hpp"
+#include "detail/noncopyable.hpp"
+
+/** Value with the sequence number of the task which produced it. */
+template <typename T>
+struct Sequenced {
+  std::size_t sequence;
+  T value;
+};
+
+/** Future of the result of a scheduled task with the sequence number of the
+ * task. Origin is the time the work which produced the task arrived at the
+ * worker. */
+template <typename T>
+struct ScheduledResult {
+  std::size_t sequence;
+  std::future<T> value;
+  std::chrono::steady_clock::time_point origin;
+  TraceContext trace;
+
+  // Result with an invalid future, which stops the consumer of the queue
+  static ScheduledResult stop_marker() {
+    return ScheduledResult{0, std::future<T>(),
+                           std::chrono::steady_clock::time_point(),
+                           TraceContext()};
+  }
+};
+
+/** When a task arrived, started and completed. */
+struct TaskTiming {
+  std::chrono::steady_clock::time_point origin;
+  std::chrono::steady_clock::time_point start;
+  std::chrono::steady_clock::time_point end;
+  TraceContext trace;
+};
+
+/** Number of executors of a ContextExecutor. The number is fixed, unless
+ * adaptive is set, in which case it follows the load between min_executors
+ * and max_executors. */
+struct ExecutorOptions {
+  std::size_t executors = Executor::default_concurrency();
+
+  // Maximum number of scheduled tasks which have not completed yet, 0 for
+  // unbounded. Scheduling blocks while the limit is reached.
+  std::size_t max_pending = 0;
+
+  // Results are returned in the order of scheduling. Otherwise they are
+  // returned as soon as they complete, so that a slow task does not hold back
+  // the results of the tasks scheduled after it.
+  bool ordered = true;
+
+  bool adaptive = false;
+  std::size_t min_executors = 1;
+  std::size_t max_executors = Executor::default_concurrency();
+  // An executor is added when a new task is expected to wait longer than
+  // target_delay, estimated from the number of queued tasks and the average
+  // execution time
+  std::chrono::microseconds target_delay{1000};
+  // An executor is removed after it was idle for idle_timeout
+  std::chrono::milliseconds idle_timeout{500};
+  // Minimal time between two changes of the number of executors
+  std::chrono::milliseconds cooldown{100};
+
+  // CPUs or NUMA node of the executor threads. Contexts are allocated by
+  // their executor threads, on the node of the thread.
+  Placement placement;
+};
+
+/** Executes tasks on a number of threads, where each thread executes the
+ * tasks in its own context. Results are pushed to the result_queue in the
+ * order of scheduling or in the order of completion, together with the
+ * sequence number of the task. Number of executors may be changed while tasks
+ * are executing. */
+template <typename ContextType>
+class ContextExecutor : noncopyable {
+ public:
+  using context_type = ContextType;
+  using argument_type = typename ContextType::argument_type;
+  using result_type = typename ContextType::result_type;
+
+  explicit ContextExecutor(ExecutorOptions options = ExecutorOptions())
+      : options_(options), last_resize_(clock::now()) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    grow_(bounded_(options_.executors));
+  }
+
+  // Executes all scheduled tasks and joins the threads
+  ~ContextExecutor() {
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      terminate_ = true;
+    }
+    cv_.notify_all();
+    for (auto &executor : executors_) {
+      executor.thread.join();
+    }
+  }
+
+  // Schedule task for execution. Tasks are numbered in the order of
+  // scheduling, starting with 0. Origin is the time the work which produced
+  // the task arrived at the worker and trace the trace it belongs to. Blocks
+  // while the number of pending tasks is at the limit.
+  void schedule_task(argument_type const &arg,
+                     std::chrono::steady_clock::time_point origin =
+                         std::chrono::steady_clock::now(),
+                     TraceContext trace = tracing::current()) {
+    task_state task;
+    task.origin = origin;
+    task.trace = trace;
+    task.function = std::packaged_task<result_type(context_type &)>(
+        [this, arg, origin, trace](context_type &context) {
+          tracing::scoped_context trace_context(trace);
+          auto start_time = clock::now();
+          auto result = context(arg);
+          if (on_timing_) {
+            on_timing_({origin, start_time, clock::now(), trace});
+          }
+          return result;
+        });
+    {
+      std::unique_lock<std::mutex> lk(mtx_);
+      not_full_.wait(lk, [this]() {
+        return options_.max_pending == 0 ||
+               tasks_.size() + running_ < options_.max_pending;
+      });
+      task.sequence = scheduled_++;
+      task.ordered = options_.ordered;
+      if (task.ordered) {
+        result_queue.push_back({task.sequence, task.function.get_future(),
+                                task.origin, task.trace});
+      }
+      tasks_.emplace_back(std::move(task));
+      if (options_.adaptive && overloaded_()) {
+        grow_(1);
+      }
+    }
+    cv_.notify_one();
+    reap_();
+  }
+
+  // Change the number of executors. Executors are removed once they finish
+  // their current task.
+  void set_options(ExecutorOptions options) {
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      options_ = options;
+      ++placement_version_;
+      auto executors = bounded_(options_.executors);
+      if (executors > active_) {
+        surplus_ = 0;
+        grow_(executors - active_);
+      } else {
+        surplus_ = active_ - executors;
+      }
+      last_resize_ = clock::now();
+    }
+    cv_.notify_all();
+    not_full_.notify_all();
+    reap_();
+  }
+
+  ExecutorOptions options() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return options_;
+  }
+
+  // Call function for all contexts and for all contexts added later
+  void configure(std::function<void(context_type &)> function) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    for (auto &executor : executors_) {
+      if (!executor.finished && executor.context) {
+        function(*executor.context);
+      }
+    }
+    configure_ = std::move(function);
+  }
+
+  // Call function after each task completes, on the thread which executed
+  // the task. Must be set before the tasks are scheduled.
+  void set_on_complete(std::function<void()> function) {
+    on_complete_ = std::move(function);
+  }
+
+  // Call function with the timing of each task before its result is ready,
+  // on the thread which executed the task. Must be set before the tasks are
+  // scheduled.
+  void set_on_timing(std::function<void(TaskTiming const &)> function) {
+    on_timing_ = std::move(function);
+  }
+
+  // Contexts of the executors
+  std::vector<std::shared_ptr<context_type>> contexts() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    std::vector<std::shared_ptr<context_type>> result;
+    for (auto const &executor : executors_) {
+      if (!executor.finished && executor.context) {
+        result.emplace_back(executor.context);
+      }
+    }
+    return result;
+  }
+
+  // Where the executor threads run. Threads are named <name>.executor.<i>.
+  std::vector<ThreadPlacement> topology(std::string const &name) const {
+    std::vector<long> thread_ids;
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      for (auto const &executor : executors_) {
+        if (!executor.finished && executor.thread_id != 0) {
+          thread_ids.push_back(executor.thread_id);
+        }
+      }
+    }
+    std::vector<ThreadPlacement> result;
+    for (std::size_t i = 0; i < thread_ids.size(); ++i) {
+      result.emplace_back(affinity::describe(
+          name + ".executor." + std::to_string(i), thread_ids[i]));
+    }
+    return result;
+  }
+
+  // Number of executors
+  std::size_t size() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return active_ - surplus_;
+  }
+
+  // Number of scheduled tasks which have not completed yet
+  std::size_t pending() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return tasks_.size() + running_;
+  }
+
+  PerformanceStatistics performance_statistics() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return timings_;
+  }
+
+  // Futures of the results with the sequence numbers of their tasks
+  threaded_queue<ScheduledResult<result_type>> result_queue;
+
+ private:
+  using clock = std::chrono::steady_clock;
+
+  struct task_state {
+    std::size_t sequence;
+    // Result was pushed to the result queue when the task was scheduled
+    bool ordered;
+    clock::time_point origin;
+    TraceContext trace;
+    std::packaged_task<result_type(context_type &)> function;
+  };
+
+  struct executor_state {
+    std::thread thread;
+    std::shared_ptr<context_type> context;
+    long thread_id = 0;
+    bool finished = false;
+  };
+
+  void run_(executor_state &self) {
+    std::unique_lock<std::mutex> lk(mtx_);
+    std::size_t placement_version = 0;
+    while (true) {
+      if (placement_version != placement_version_) {
+        placement_version = placement_version_;
+        auto placement = options_.placement;
+        lk.unlock();
+        affinity::apply(placement);
+        lk.lock();
+      }
+      if (!self.context) {
+        // Context is allocated on the node of the thread
+        lk.unlock();
+        auto context = std::make_shared<context_type>();
+        lk.lock();
+        if (configure_) {
+          configure_(*context);
+        }
+        self.context = std::move(context);
+        self.thread_id = affinity::current_thread_id();
+        continue;
+      }
+      if (surplus_ > 0) {
+        --surplus_;
+        break;
+      }
+      if (tasks_.empty()) {
+        if (terminate_) {
+          break;
+        }
+        if (!options_.adaptive) {
+          cv_.wait(lk);
+        } else if (cv_.wait_for(lk, options_.idle_timeout) ==
+                       std::cv_status::timeout &&
+                   tasks_.empty() && !terminate_ && idle_()) {
+          last_resize_ = clock::now();
+          break;
+        }
+        continue;
+      }
+
+      auto task = std::move(tasks_.front());
+      tasks_.pop_front();
+      ++running_;
+      lk.unlock();
+      // Result of an unordered task is returned once it is ready
+      std::future<result_type> result;
+      if (!task.ordered) {
+        result = task.function.get_future();
+      }
+      auto start_time = clock::now();
+      task.function(*self.context);
+      auto duration = clock::now() - start_time;
+      if (!task.ordered) {
+        result_queue.push_back(
+            {task.sequence, std::move(result), task.origin, task.trace});
+      }
+      if (on_complete_) {
+        on_complete_();
+      }
+      lk.lock();
+      --running_;
+      not_full_.notify_one();
+      timings_.update(duration);
+      // Exponential moving average with the weight of 1/8 for the last task
+      average_ += (duration - average_) / 8;
+    }
+    --active_;
+    ++finished_;
+    self.finished = true;
+  }
+
+  // Add executors. Must be called with the mutex locked.
+  void grow_(std::size_t count) {
+    for (std::size_t i = 0; i < count; ++i) {
+      executors_.emplace_back();
+      auto &executor = executors_.back();
+      executor.thread = std::thread([this, &executor]() { run_(executor); });
+      ++active_;
+    }
+    if (count > 0) {
+      last_resize_ = clock::now();
+    }
+  }
+
+  // Join the threads of the removed executors
+  void reap_() {
+    std::list<executor_state> finished;
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      if (finished_ == 0) {
+        return;
+      }
+      finished_ = 0;
+      for (auto it = executors_.begin(); it != executors_.end();) {
+        auto next = std::next(it);
+        if (it->finished) {
+          finished.splice(finished.end(), executors_, it);
+        }
+        it = next;
+      }
+    }
+    for (auto &executor : finished) {
+      executor.thread.join();
+    }
+  }
+
+  // True if a new task is expected to wait longer than the target delay and
+  // an executor may be added. Must be called with the mutex locked.
+  bool overloaded_() const {
+    auto executors = active_ - surplus_;
+    if (executors >= options_.max_executors || cooling_down_()) {
+      return false;
+    }
+    auto delay = average_ * tasks_.size() / std::max<std::size_t>(executors, 1);
+    return delay > options_.target_delay;
+  }
+
+  // True if an idle executor may be removed. Must be called with the mutex
+  // locked.
+  bool idle_() const {
+    return active_ - surplus_ > options_.min_executors && !cooling_down_();
+  }
+
+  bool cooling_down_() const {
+    return clock::now() - last_resize_ < options_.cooldown;
+  }
+
+  std::size_t bounded_(std::size_t executors) const {
+    if (options_.adaptive) {
+      executors = std::min(std::max(executors, options_.min_executors),
+                           options_.max_executors);
+    }
+    return std::max<std::size_t>(executors, 1u);
+  }
+
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+  // Notified when a task completes
+  std::condition_variable not_full_;
+  std::deque<task_state> tasks_;
+  // Number of scheduled tasks
+  std::size_t scheduled_ = 0;
+
+  ExecutorOptions options_;
+  std::function<void(context_type &)> configure_;
+  std::function<void()> on_complete_;
+  std::function<void(TaskTiming const &)> on_timing_;
+  // Incremented when the options change, so that the executors apply the
+  // placement again
+  std::size_t placement_version_ = 1;
+
+  // All executors, including the removed ones which were not joined yet
+  std::list<executor_state> executors_;
+  // Number of running executor threads
+  std::size_t active_ = 0;
+  // Number of executors which should be removed
+  std::size_t surplus_ = 0;
+  // Number of removed executors which were not joined yet
+  std::size_t finished_ = 0;
+  // Number of tasks being executed
+  std::size_t running_ = 0;
+  bool terminate_ = false;
+
+  PerformanceStatistics timings_;
+  // Average execution time
+  clock::duration average_{0};
+  clock::time_point last_resize_;
+};
+
+#endif
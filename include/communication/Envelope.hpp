@@ -0,0 +1,19 @@
+#ifndef ENVELOPE_HPP
+#define ENVELOPE_HPP
+
+#pragma once
+
+#include <memory>
+
+/** Immutable, reference counted payload. Services and workers with an
+ * Envelope<T> argument share a single payload among all the subscribers,
+ * instead of copying it for each of them. */
+template <typename T>
+using Envelope = std::shared_ptr<T const>;
+
+template <typename T, typename... Args>
+Envelope<T> make_envelope(Args &&... args) {
+  return std::make_shared<T>(std::forward<Args>(args)...);
+}
+
+#endif
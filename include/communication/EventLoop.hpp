@@ -0,0 +1,212 @@
+#ifndef EVENT_LOOP_HPP
+#define EVENT_LOOP_HPP
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "detail/noncopyable.hpp"
+
+/** Loop on a single thread, which runs the posted functions, the functions
+ * waiting for a file descriptor to become ready and the timers. Waiting is
+ * done with epoll, so that one thread serves any number of pending operations.
+ * Functions run on the loop thread and must not block it. */
+class EventLoop : noncopyable {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  EventLoop()
+      : epoll_fd_(::epoll_create1(EPOLL_CLOEXEC)),
+        wake_fd_(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {
+    if (epoll_fd_ < 0 || wake_fd_ < 0) {
+      close_fds_();
+      throw std::system_error(errno, std::system_category(), "event loop");
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = wake_fd_;
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event);
+    thread_ = std::thread([this]() { run_(); });
+  }
+
+  // Pending functions are discarded
+  ~EventLoop() {
+    terminate_ = true;
+    wake_();
+    thread_.join();
+    close_fds_();
+  }
+
+  // Run the function on the loop thread
+  void post(std::function<void()> function) {
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      posted_.push_back(std::move(function));
+    }
+    wake_();
+  }
+
+  // Run the function on the loop thread once the descriptor is ready for the
+  // epoll events, e.g. EPOLLIN. A descriptor has a single waiting function at
+  // a time. Errors and hang-ups count as ready, the function finds them when
+  // it reads or writes.
+  void on_ready(int fd, std::uint32_t events, std::function<void()> function) {
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      waiting_[fd] = std::move(function);
+    }
+    epoll_event event{};
+    event.events = events | EPOLLONESHOT;
+    event.data.fd = fd;
+    // Descriptor stays registered, disabled, after it was ready once
+    if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0 &&
+        (errno != EEXIST ||
+         ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) != 0)) {
+      auto error = errno;
+      {
+        std::lock_guard<std::mutex> lk(mtx_);
+        waiting_.erase(fd);
+      }
+      throw std::system_error(error, std::system_category(), "epoll_ctl");
+    }
+  }
+
+  // Run the function on the loop thread after the delay
+  void after(clock::duration delay, std::function<void()> function) {
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      timers_.push({clock::now() + delay, next_timer_++, std::move(function)});
+    }
+    wake_();
+  }
+
+  bool in_loop() const noexcept {
+    return std::this_thread::get_id() == thread_.get_id();
+  }
+
+  // Loop shared by the coroutine workers
+  static std::shared_ptr<EventLoop> shared() {
+    static auto loop = std::make_shared<EventLoop>();
+    return loop;
+  }
+
+ private:
+  struct timer {
+    clock::time_point due;
+    std::uint64_t order;
+    std::function<void()> function;
+
+    // Earliest timer on top of the queue
+    bool operator<(timer const &other) const {
+      return due != other.due ? due > other.due : order > other.order;
+    }
+  };
+
+  void run_() {
+    std::vector<epoll_event> events(64);
+    std::vector<std::function<void()>> ready;
+    while (!terminate_) {
+      auto count = ::epoll_wait(epoll_fd_, events.data(),
+                                static_cast<int>(events.size()), timeout_());
+      {
+        std::lock_guard<std::mutex> lk(mtx_);
+        for (int i = 0; i < count; ++i) {
+          auto fd = events[i].data.fd;
+          if (fd == wake_fd_) {
+            std::uint64_t value;
+            while (::read(wake_fd_, &value, sizeof(value)) > 0) {
+            }
+            continue;
+          }
+          auto waiting = waiting_.find(fd);
+          if (waiting != waiting_.end()) {
+            ready.push_back(std::move(waiting->second));
+            waiting_.erase(waiting);
+          }
+        }
+        std::move(posted_.begin(), posted_.end(), std::back_inserter(ready));
+        posted_.clear();
+        auto now = clock::now();
+        while (!timers_.empty() && timers_.top().due <= now) {
+          // Function is moved out of the top before it is popped
+          auto &top = const_cast<timer &>(timers_.top());
+          ready.push_back(std::move(top.function));
+          timers_.pop();
+        }
+      }
+      for (auto &function : ready) {
+        if (terminate_) {
+          break;
+        }
+        function();
+      }
+      ready.clear();
+    }
+  }
+
+  // Milliseconds until the next timer, -1 if there is none
+  int timeout_() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (!posted_.empty()) {
+      return 0;
+    }
+    if (timers_.empty()) {
+      return -1;
+    }
+    auto delay = timers_.top().due - clock::now();
+    if (delay <= clock::duration::zero()) {
+      return 0;
+    }
+    // Rounded up, so that the timer is due when the loop wakes up
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                  delay + std::chrono::milliseconds(1) - clock::duration(1))
+                  .count();
+    return static_cast<int>(std::min<decltype(ms)>(ms, 1 << 30));
+  }
+
+  void wake_() {
+    std::uint64_t value = 1;
+    auto written = ::write(wake_fd_, &value, sizeof(value));
+    (void)written;
+  }
+
+  void close_fds_() {
+    if (epoll_fd_ >= 0) {
+      ::close(epoll_fd_);
+    }
+    if (wake_fd_ >= 0) {
+      ::close(wake_fd_);
+    }
+  }
+
+  int epoll_fd_;
+  // Wakes the loop for the posted functions, the timers and termination
+  int wake_fd_;
+  std::atomic<bool> terminate_{false};
+  // Guards the posted functions, the waiting functions and the timers
+  std::mutex mtx_;
+  std::vector<std::function<void()>> posted_;
+  std::unordered_map<int, std::function<void()>> waiting_;
+  std::priority_queue<timer> timers_;
+  std::uint64_t next_timer_ = 0;
+  std::thread thread_;
+};
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef EXECUTOR_HPP
+#define EXECUTOR_HPP
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "detail/noncopyable.hpp"
+
+/** A pool of threads executing submitted tasks. Each thread has its own queue.
+ * Tasks submitted from a thread of the pool are queued on that thread and
+ * tasks submitted from other threads are spread over the queues. Threads
+ * execute the tasks of their own queue in the order of submission and steal
+ * from the other queues when their own queue is empty. Threads waiting for the
+ * results of the submitted tasks should execute the pending tasks themselves
+ * (try_run_one), so that the tasks that wait for other tasks do not exhaust
+ * the pool. */
+class Executor : noncopyable {
+ public:
+  explicit Executor(std::size_t nthreads = default_concurrency())
+      : pending_(0), sleeping_(0), next_(0), terminate_(false) {
+    nthreads = std::max<std::size_t>(nthreads, 1u);
+    for (std::size_t i = 0; i < nthreads; ++i) {
+      queues_.emplace_back(new task_queue());
+    }
+    for (std::size_t i = 0; i < nthreads; ++i) {
+      threads_.emplace_back([this, i]() { run_(i); });
+    }
+  }
+
+  // Executes all pending tasks and joins the threads
+  ~Executor() {
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      terminate_ = true;
+    }
+    cv_.notify_all();
+    for (auto &thread : threads_) {
+      thread.join();
+    }
+  }
+
+  // Submit a task for execution. Tasks must not throw.
+  void submit(std::function<void()> task) {
+    auto &queue = *queues_[current_index_()];
+    {
+      std::lock_guard<std::mutex> lk(queue.mtx);
+      queue.tasks.emplace_back(std::move(task));
+      pending_.fetch_add(1);
+    }
+    // A thread going to sleep either sees the task or is counted as sleeping
+    if (sleeping_.load() > 0) {
+      { std::lock_guard<std::mutex> lk(mtx_); }
+      cv_.notify_one();
+    }
+  }
+
+  // Submit a function for execution. The returned future holds the result or
+  // the exception thrown by the function.
+  template <typename Function>
+  std::future<decltype(std::declval<Function &>()())> async(
+      Function function) {
+    using result_type = decltype(function());
+    auto task = std::make_shared<std::packaged_task<result_type()>>(
+        std::move(function));
+    auto result = task->get_future();
+    submit([task]() { (*task)(); });
+    return result;
+  }
+
+  // Execute one pending task on the calling thread. Returns false if there
+  // was no pending task.
+  bool try_run_one() {
+    std::function<void()> task;
+    if (!take_(current_index_(), task)) {
+      return false;
+    }
+    task();
+    return true;
+  }
+
+  // Number of threads
+  std::size_t size() const noexcept { return threads_.size(); }
+
+  // Executor shared by the whole process. Has a thread per core.
+  static std::shared_ptr<Executor> shared() {
+    static auto executor = std::make_shared<Executor>();
+    return executor;
+  }
+
+  static std::size_t default_concurrency() noexcept {
+    return std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+ private:
+  struct task_queue {
+    std::mutex mtx;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  // Executor and queue of the calling thread
+  struct thread_state {
+    Executor const *executor = nullptr;
+    std::size_t index = 0;
+  };
+
+  static thread_state &current_() {
+    static thread_local thread_state state;
+    return state;
+  }
+
+  // Queue of the calling thread if it belongs to the pool, otherwise the next
+  // queue in turn
+  std::size_t current_index_() {
+    auto const &state = current_();
+    if (state.executor == this) {
+      return state.index;
+    }
+    return next_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+  }
+
+  // Take a task from the queue at index, or steal one from the others
+  bool take_(std::size_t index, std::function<void()> &task) {
+    if (pending_.load() == 0) {
+      return false;
+    }
+    for (std::size_t i = 0; i < queues_.size(); ++i) {
+      auto &queue = *queues_[(index + i) % queues_.size()];
+      std::lock_guard<std::mutex> lk(queue.mtx);
+      if (queue.tasks.empty()) {
+        continue;
+      }
+      // Own tasks are taken in the order of submission, stolen from the back
+      if (i == 0) {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+      } else {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+      }
+      pending_.fetch_sub(1);
+      return true;
+    }
+    return false;
+  }
+
+  void run_(std::size_t index) {
+    current_().executor = this;
+    current_().index = index;
+    while (true) {
+      std::function<void()> task;
+      if (take_(index, task)) {
+        task();
+        continue;
+      }
+      std::unique_lock<std::mutex> lk(mtx_);
+      sleeping_.fetch_add(1);
+      cv_.wait(lk, [this]() { return terminate_ || pending_.load() > 0; });
+      sleeping_.fetch_sub(1);
+      if (terminate_ && pending_.load() == 0) {
+        return;
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<task_queue>> queues_;
+  // Number of queued tasks in all queues
+  std::atomic<std::size_t> pending_;
+  // Number of threads waiting for tasks
+  std::atomic<std::size_t> sleeping_;
+  // Queue of the next task submitted from outside the pool
+  std::atomic<std::size_t> next_;
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  bool terminate_;
+  std::vector<std::thread> threads_;
+};
+
+#endif
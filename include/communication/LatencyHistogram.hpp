@@ -0,0 +1,224 @@
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+#include <intrin.h>
+#endif
+
+#include "detail/noncopyable.hpp"
+
+namespace detail {
+// Index of the most significant set bit. Value must not be zero.
+inline unsigned most_significant_bit(std::uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+  return 63 - static_cast<unsigned>(__builtin_clzll(value));
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+  unsigned long index;
+  _BitScanReverse64(&index, value);
+  return static_cast<unsigned>(index);
+#else
+  unsigned msb = 0;
+  while (value >>= 1) {
+    ++msb;
+  }
+  return msb;
+#endif
+}
+}
+
+/** Snapshot of a LatencyHistogram. Values are in nanoseconds. Snapshots of the
+ * same or of different histograms can be merged, e.g. to sum up the workers
+ * of a pipeline or several intervals. */
+struct HistogramSnapshot {
+  // Number of values per bucket, see LatencyHistogram for the bucket bounds
+  std::vector<std::uint64_t> counts;
+  std::uint64_t count = 0;
+  std::uint64_t sum = 0;
+  std::uint64_t min = std::numeric_limits<std::uint64_t>::max();
+  std::uint64_t max = 0;
+
+  bool empty() const { return count == 0; }
+
+  double mean() const {
+    return count == 0 ? 0 : static_cast<double>(sum) / count;
+  }
+
+  // Value which is not exceeded by the fraction of the values, e.g. 0.99 for
+  // the 99th percentile. Returns the upper bound of the bucket, which is at
+  // most 3% above the exact value.
+  std::uint64_t percentile(double fraction) const;
+
+  HistogramSnapshot &merge(HistogramSnapshot const &other) {
+    if (counts.size() < other.counts.size()) {
+      counts.resize(other.counts.size(), 0);
+    }
+    for (std::size_t i = 0; i < other.counts.size(); ++i) {
+      counts[i] += other.counts[i];
+    }
+    count += other.count;
+    sum += other.sum;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+    return *this;
+  }
+};
+
+/** Histogram of durations with logarithmic buckets, in the manner of
+ * HdrHistogram. Each power of two is split into 32 buckets, so that a value
+ * is known within 3%. Values up to 2^40 ns (about 18 minutes) are recorded,
+ * larger ones are clamped. Recording is lock-free and may be done from any
+ * number of threads. */
+class LatencyHistogram : noncopyable {
+ public:
+  static constexpr unsigned sub_bucket_bits = 5;
+  static constexpr unsigned value_bits = 40;
+  static constexpr std::uint64_t sub_buckets = 1u << sub_bucket_bits;
+  static constexpr std::size_t bucket_count =
+      (value_bits - sub_bucket_bits + 1) * sub_buckets;
+  static constexpr std::uint64_t max_value =
+      (std::uint64_t(1) << value_bits) - 1;
+
+  LatencyHistogram() = default;
+
+  void record(std::chrono::nanoseconds duration) {
+    auto value = static_cast<std::uint64_t>(
+        std::max<std::chrono::nanoseconds::rep>(duration.count(), 0));
+    value = std::min(value, max_value);
+    counts_[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    update_min_(value);
+    update_max_(value);
+  }
+
+  // Snapshot of the recorded values. If reset is set, the histogram starts a
+  // new interval. Values recorded during the snapshot belong to either of the
+  // intervals.
+  HistogramSnapshot snapshot(bool reset = false) {
+    HistogramSnapshot result;
+    result.counts.resize(bucket_count);
+    for (std::size_t i = 0; i < bucket_count; ++i) {
+      result.counts[i] = reset
+                             ? counts_[i].exchange(0, std::memory_order_relaxed)
+                             : counts_[i].load(std::memory_order_relaxed);
+      result.count += result.counts[i];
+    }
+    if (reset) {
+      result.sum = sum_.exchange(0, std::memory_order_relaxed);
+      result.min = min_.exchange(std::numeric_limits<std::uint64_t>::max(),
+                                 std::memory_order_relaxed);
+      result.max = max_.exchange(0, std::memory_order_relaxed);
+    } else {
+      result.sum = sum_.load(std::memory_order_relaxed);
+      result.min = min_.load(std::memory_order_relaxed);
+      result.max = max_.load(std::memory_order_relaxed);
+    }
+    return result;
+  }
+
+  void reset() { snapshot(true); }
+
+  // Bucket of the value. Values below 32 have a bucket each.
+  static std::size_t bucket(std::uint64_t value) {
+    if (value < sub_buckets) {
+      return static_cast<std::size_t>(value);
+    }
+    auto msb = detail::most_significant_bit(value);
+    auto shift = msb - sub_bucket_bits;
+    return (shift + 1) * sub_buckets +
+           static_cast<std::size_t>((value >> shift) & (sub_buckets - 1));
+  }
+
+  // Largest value of the bucket
+  static std::uint64_t upper_bound(std::size_t bucket) {
+    if (bucket < sub_buckets) {
+      return bucket;
+    }
+    auto shift = bucket / sub_buckets - 1;
+    auto lower = (sub_buckets + bucket % sub_buckets) << shift;
+    return lower + (std::uint64_t(1) << shift) - 1;
+  }
+
+ private:
+  void update_min_(std::uint64_t value) {
+    auto current = min_.load(std::memory_order_relaxed);
+    while (value < current &&
+           !min_.compare_exchange_weak(current, value,
+                                       std::memory_order_relaxed)) {
+    }
+  }
+
+  void update_max_(std::uint64_t value) {
+    auto current = max_.load(std::memory_order_relaxed);
+    while (value > current &&
+           !max_.compare_exchange_weak(current, value,
+                                       std::memory_order_relaxed)) {
+    }
+  }
+
+  std::array<std::atomic<std::uint64_t>, bucket_count> counts_{};
+  std::atomic<std::uint64_t> sum_{0};
+  std::atomic<std::uint64_t> min_{std::numeric_limits<std::uint64_t>::max()};
+  std::atomic<std::uint64_t> max_{0};
+};
+
+inline std::uint64_t HistogramSnapshot::percentile(double fraction) const {
+  if (count == 0) {
+    return 0;
+  }
+  if (fraction <= 0) {
+    return min;
+  }
+  auto rank = static_cast<std::uint64_t>(
+      std::ceil(std::min(fraction, 1.0) * count));
+  rank = std::max<std::uint64_t>(rank, 1);
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < counts.size(); ++i) {
+    seen += counts[i];
+    if (seen >= rank) {
+      return std::min(std::max(LatencyHistogram::upper_bound(i), min), max);
+    }
+  }
+  return max;
+}
+
+/** Latencies of the tasks of a worker. Queue wait is the time from the
+ * arrival of the task at the worker until its execution starts, execution is
+ * the time spent running it and end-to-end the time until its result is
+ * signalled. Latencies are recorded before the result is signalled. */
+struct LatencyMetrics {
+  HistogramSnapshot queue_wait;
+  HistogramSnapshot execution;
+  HistogramSnapshot end_to_end;
+
+  LatencyMetrics &merge(LatencyMetrics const &other) {
+    queue_wait.merge(other.queue_wait);
+    execution.merge(other.execution);
+    end_to_end.merge(other.end_to_end);
+    return *this;
+  }
+};
+
+/** Histograms of LatencyMetrics. */
+struct LatencyHistograms : noncopyable {
+  LatencyHistogram queue_wait;
+  LatencyHistogram execution;
+  LatencyHistogram end_to_end;
+
+  LatencyMetrics snapshot(bool reset = false) {
+    return {queue_wait.snapshot(reset), execution.snapshot(reset),
+            end_to_end.snapshot(reset)};
+  }
+};
+
+#endif
@@ -0,0 +1,215 @@
+#ifndef MAILBOX_HPP
+#define MAILBOX_HPP
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include <boost/optional.hpp>
+
+#include "Executor.hpp"
+#include "detail/noncopyable.hpp"
+#include "detail/traits.hpp"
+
+/** What a full mailbox does with a new message. */
+enum class Overflow {
+  // Emitter waits until the subscriber makes room
+  Block,
+  // Oldest pending message is dropped to make room
+  DropOldest,
+  // New message is dropped
+  DropNewest
+};
+
+/** Dispatch policy of a queued subscriber. */
+struct DispatchPolicy {
+  // Maximum number of pending messages, 0 for unbounded
+  std::size_t capacity = 0;
+  // What to do when the mailbox is full
+  Overflow overflow = Overflow::Block;
+  // Executor delivering the messages, Executor::shared() if not set
+  std::shared_ptr<Executor> executor;
+  // Called with the exceptions thrown by the subscriber. Exceptions are
+  // ignored if not set.
+  std::function<void(std::exception_ptr)> on_error;
+};
+
+/** Queue of messages for a single subscriber. Posting a message only enqueues
+ * it. Messages are delivered on the executor in the order of posting, one at a
+ * time, so that the subscriber is never called concurrently and a slow
+ * subscriber does not hold up the emitter or the other subscribers. The
+ * executor must outlive the posting of the messages. It may be destroyed
+ * before the mailbox, since it delivers all pending messages on destruction. */
+template <typename... Args>
+class Mailbox : public std::enable_shared_from_this<Mailbox<Args...>>,
+                noncopyable {
+ public:
+  using message_type = std::tuple<std::decay_t<Args>...>;
+  using function_type = std::function<void(Args...)>;
+
+  Mailbox(function_type function, Executor &executor, std::size_t capacity,
+          Overflow overflow,
+          std::function<void(std::exception_ptr)> on_error = nullptr)
+      : function_(std::move(function)),
+        executor_(executor),
+        capacity_(capacity),
+        overflow_(overflow),
+        on_error_(std::move(on_error)),
+        scheduled_(false),
+        dropped_(0) {}
+
+  // Enqueue the message and schedule its delivery. Returns false if the
+  // message was dropped. With Overflow::Block, a subscriber posting to its own
+  // full mailbox deadlocks.
+  bool post(message_type message) {
+    std::unique_lock<std::mutex> lk(mtx_);
+    if (capacity_ != 0 && messages_.size() >= capacity_) {
+      switch (overflow_) {
+        case Overflow::Block:
+          not_full_.wait(lk, [this]() { return messages_.size() < capacity_; });
+          break;
+        case Overflow::DropOldest:
+          messages_.pop_front();
+          ++dropped_;
+          break;
+        case Overflow::DropNewest:
+          ++dropped_;
+          return false;
+      }
+    }
+    messages_.emplace_back(std::move(message));
+    if (!scheduled_) {
+      scheduled_ = true;
+      lk.unlock();
+      schedule();
+    }
+    return true;
+  }
+
+  // Number of messages waiting for delivery
+  std::size_t pending() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return messages_.size();
+  }
+
+  // Number of messages dropped because the mailbox was full
+  std::size_t dropped() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return dropped_;
+  }
+
+ private:
+  // Messages delivered by a single executor task, before the mailbox yields
+  // the thread to the other tasks
+  static constexpr std::size_t batch_size = 16;
+
+  void schedule() {
+    auto self = this->shared_from_this();
+    executor_.submit([self]() { self->deliver(); });
+  }
+
+  // Deliver up to batch_size messages. Only one delivery is scheduled at a
+  // time.
+  void deliver() {
+    for (std::size_t i = 0; i < batch_size; ++i) {
+      boost::optional<message_type> message;
+      {
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (messages_.empty()) {
+          scheduled_ = false;
+          return;
+        }
+        message = std::move(messages_.front());
+        messages_.pop_front();
+      }
+      not_full_.notify_one();
+      try {
+        call(*message, std::index_sequence_for<Args...>());
+      } catch (...) {
+        if (on_error_) {
+          on_error_(std::current_exception());
+        }
+      }
+    }
+    schedule();
+  }
+
+  template <std::size_t... S>
+  void call(message_type &message, std::index_sequence<S...>) {
+    function_(std::move(std::get<S>(message))...);
+  }
+
+  function_type function_;
+  Executor &executor_;
+  std::size_t capacity_;
+  Overflow overflow_;
+  std::function<void(std::exception_ptr)> on_error_;
+
+  mutable std::mutex mtx_;
+  std::condition_variable not_full_;
+  std::deque<message_type> messages_;
+  // True while a delivery is scheduled on the executor
+  bool scheduled_;
+  std::size_t dropped_;
+};
+
+namespace detail {
+template <typename Signature>
+class queued_slot;
+
+// Slot posting its arguments to the mailbox. Has the same signature as the
+// subscriber, so that the broker connects it to the same services. Keeps the
+// executor of the mailbox alive.
+template <typename... Args>
+class queued_slot<void(Args...)> {
+ public:
+  using mailbox_type = Mailbox<Args...>;
+
+  template <typename Function>
+  queued_slot(Function function, DispatchPolicy policy)
+      : executor_(policy.executor ? std::move(policy.executor)
+                                  : Executor::shared()),
+        mailbox_(std::make_shared<mailbox_type>(
+            std::move(function), *executor_, policy.capacity,
+            policy.overflow, std::move(policy.on_error))) {}
+
+  void operator()(Args... args) const {
+    mailbox_->post(
+        typename mailbox_type::message_type(std::forward<Args>(args)...));
+  }
+
+  std::shared_ptr<mailbox_type> const &mailbox() const noexcept {
+    return mailbox_;
+  }
+
+ private:
+  std::shared_ptr<Executor> executor_;
+  std::shared_ptr<mailbox_type> mailbox_;
+};
+}
+
+/** Wrap the subscriber into a slot which delivers the messages through its own
+ * mailbox. All the connections of the returned slot share the mailbox.
+ * Subscriber must return void. Pending messages are delivered even if the
+ * slot is disconnected. */
+template <typename Function>
+auto queued(Function function, DispatchPolicy policy = {}) {
+  using signature =
+      typename utils::function_traits<std::decay_t<Function>>::function_type;
+  using slot_type = detail::queued_slot<signature>;
+  static_assert(
+      std::is_void<typename utils::function_traits<
+          std::decay_t<Function>>::result_type>::value,
+      "Queued subscribers must return void.");
+  return slot_type(std::move(function), std::move(policy));
+}
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "detail/noncopyable.hpp"
+#include "WorkerSingleThreaded.hpp"
+
+namespace detail {
+template <typename Argument, typename Result, typename Broker,
+          typename Configuration, typename Policy>
+std::true_type is_single_threaded(
+    WorkerSingleThreadedT<Argument, Result, Broker, Configuration, Policy> const
+        *);
+std::false_type is_single_threaded(...);
+
+// Workers which can run the tasks on the delivering thread
+template <typename Worker>
+using is_fusable =
+    decltype(is_single_threaded(std::declval<Worker const *>()));
+}
+
+/** Builds a pipeline of workers connected by name and fuses its linear chains
+ * of single-threaded workers. A single-threaded worker is fused with its input
+ * if the input is the only one, is a single-threaded worker of the pipeline
+ * and has no other consumer. Fused workers run on the thread of the first
+ * worker of the chain as direct calls and do not keep threads of their own.
+ * Where the pipeline branches or joins, the workers keep their queues and
+ * threads. */
+template <typename BrokerType>
+class PipelineT : noncopyable {
+ public:
+  explicit PipelineT(std::shared_ptr<BrokerType> broker)
+      : broker_(std::move(broker)) {}
+
+  // Workers are destroyed in the order they were added, so that a chain stops
+  // at its first worker
+  ~PipelineT() {
+    for (auto &stage : stages_) {
+      stage.worker.reset();
+    }
+  }
+
+  // Construct the worker with the name, the broker, the names of its inputs
+  // and the further arguments, e.g. the ExecutorOptions of a multi-threaded
+  // worker. Inputs need not be workers of the pipeline.
+  template <typename Worker, typename... Args>
+  Worker &add(std::string const &name, std::vector<std::string> const &inputs,
+              Args &&... args) {
+    auto worker = std::make_shared<Worker>(name, broker_, inputs,
+                                           std::forward<Args>(args)...);
+    stage entry{name, inputs, worker, nullptr, nullptr};
+    bind_fusion_(entry, worker.get(), detail::is_fusable<Worker>());
+    stages_.push_back(std::move(entry));
+    return *worker;
+  }
+
+  // Fuse the chains and return the names of the fused workers. Call it once
+  // the consumers outside of the pipeline are connected. Tasks queued by then
+  // run first, in order. Fusion cannot be undone. Must not be called from the
+  // threads of the workers.
+  std::vector<std::string> fuse() {
+    std::vector<std::string> fused;
+    for (auto &stage : stages_) {
+      if (!stage.fuse || stage.inputs.size() != 1) {
+        continue;
+      }
+      auto input = find_(stage.inputs.front());
+      if (input == stages_.end() || !input->fuse ||
+          input->consumers() != 1 || consumers_in_pipeline_(input->name) != 1) {
+        continue;
+      }
+      stage.fuse();
+      fused.push_back(stage.name);
+    }
+    return fused;
+  }
+
+  std::size_t size() const noexcept { return stages_.size(); }
+
+ private:
+  struct stage {
+    std::string name;
+    std::vector<std::string> inputs;
+    std::shared_ptr<void> worker;
+    // Set for the single-threaded workers
+    std::function<void()> fuse;
+    // Number of callbacks connected to the results
+    std::function<std::size_t()> consumers;
+  };
+
+  template <typename Worker>
+  void bind_fusion_(stage &stage, Worker *worker, std::true_type) {
+    stage.fuse = [worker]() { fuse_(*worker); };
+    stage.consumers = [worker]() {
+      return worker->result_signal.service->num_slots() +
+             worker->batch_result_signal.service->num_slots();
+    };
+  }
+
+  template <typename Worker>
+  void bind_fusion_(stage &, Worker *, std::false_type) {}
+
+  // Fusion is private to the single-threaded worker
+  template <typename Argument, typename Result, typename Broker,
+            typename Configuration, typename Policy>
+  static void fuse_(WorkerSingleThreadedT<Argument, Result, Broker,
+                                          Configuration, Policy> &worker) {
+    worker.fuse_();
+  }
+
+  typename std::vector<stage>::iterator find_(std::string const &name) {
+    return std::find_if(stages_.begin(), stages_.end(),
+                        [&name](stage const &s) { return s.name == name; });
+  }
+
+  std::size_t consumers_in_pipeline_(std::string const &name) const {
+    return std::count_if(stages_.begin(), stages_.end(),
+                         [&name](stage const &s) {
+                           return std::find(s.inputs.begin(), s.inputs.end(),
+                                            name) != s.inputs.end();
+                         });
+  }
+
+  std::shared_ptr<BrokerType> broker_;
+  std::vector<stage> stages_;
+};
+
+#endif
@@ -3,20 +3,50 @@
 
 #pragma once
 
+#include <future>
 #include <string>
 #include <tuple>
 #include <memory>
 
 #include <boost/signals2.hpp>
 
+#include "Envelope.hpp"
+#include "Executor.hpp"
+#include "Signal.hpp"
+
+// Services use boost::signals2 by default. Define
+// COMMUNICATION_LOCKFREE_SIGNAL (CMake option lockfree_signal) to use Signal,
+// which emits without locks and allocations, in all services and workers.
+#ifdef COMMUNICATION_LOCKFREE_SIGNAL
+template <typename Signature>
+using signal_t = Signal<Signature>;
+using Connection = SignalConnection;
+#else
+template <typename Signature>
+using signal_t = boost::signals2::signal<Signature>;
+using Connection = boost::signals2::connection;
+#endif
+
 namespace detail {
+// Emit the arguments, moving them into the last slot if the signal supports
+// it
+template <typename Signature, typename... Args>
+decltype(auto) emit(Signal<Signature> const &signal, Args &&... args) {
+  return signal.emit(std::forward<Args>(args)...);
+}
+
+template <typename SignalType, typename... Args>
+decltype(auto) emit(SignalType const &signal, Args &&... args) {
+  return signal(args...);
+}
+
 // Provides implementation for the services with void and not void return
 // type. Combines necessary information about each service, such as service
 // name and group and which signal will be triggered.
 template <typename ResultType, typename... Args> struct ServiceImpl {
   using argument_type = std::tuple<Args...>;
   using result_type = ResultType;
-  using signal_type = boost::signals2::signal<result_type(Args...)>;
+  using signal_type = signal_t<result_type(Args...)>;
 
   /** Construct new service.  */
   ServiceImpl(std::string const &name) : name(name), service(new signal_type) {}
@@ -36,9 +66,22 @@ struct Service : detail::ServiceImpl<ResultType, Args...> {
   using Base = detail::ServiceImpl<ResultType, Args...>;
   // Implementation for signals with return type
   Service(std::string const &name) : Base(name) {}
-  typename Base::result_type operator()(Args const &... args) {
+  typename Base::result_type operator()(Args const &... args) const {
     return this->service->operator()(args...).value();
   }
+
+  // Same as operator(), but moves the arguments into the last connected slot.
+  // Arguments are always copied with boost::signals2.
+  typename Base::result_type emit(Args &&... args) const {
+    return detail::emit(*this->service, std::forward<Args>(args)...).value();
+  }
+
+  // Call the service on the executor. Arguments are copied.
+  std::future<typename Base::result_type> async(Executor &executor,
+                                                Args const &... args) const {
+    Service service(*this);
+    return executor.async([service, args...]() { return service(args...); });
+  }
 };
 
 /**
@@ -48,9 +91,22 @@ template <typename... Args>
 struct Service<void, Args...> : detail::ServiceImpl<void, Args...> {
   using Base = detail::ServiceImpl<void, Args...>;
   Service(std::string const &name) : Base(name) {}
-  typename Base::result_type operator()(Args const &... args) {
+  typename Base::result_type operator()(Args const &... args) const {
     this->service->operator()(args...);
   }
+
+  // Same as operator(), but moves the arguments into the last connected slot.
+  // Arguments are always copied with boost::signals2.
+  void emit(Args &&... args) const {
+    detail::emit(*this->service, std::forward<Args>(args)...);
+  }
+
+  // Call the service on the executor. Arguments are copied.
+  std::future<typename Base::result_type> async(Executor &executor,
+                                                Args const &... args) const {
+    Service service(*this);
+    return executor.async([service, args...]() { return service(args...); });
+  }
 };
 
 #endif
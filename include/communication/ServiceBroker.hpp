@@ -2,15 +2,27 @@
 #define SERVICE_BROKER_HPP
 
 #include <boost/signals2.hpp>
-#include <boost/any.hpp>
-#include <boost/property_tree/ptree.hpp>
+#include <boost/optional.hpp>
+#include <boost/utility/string_view.hpp>
+#include <boost/container/small_vector.hpp>
 
+#include <deque>
 #include <unordered_map>
+#include <map>
+#include <memory>
+#include <algorithm>
+#include <future>
 #include <stdexcept>
 #include <tuple>
-#include <stack>
 
 #include "Service.hpp"
+#include "Executor.hpp"
+#include "Mailbox.hpp"
+#include "ServiceHandle.hpp"
+#include "StreamingCombiner.hpp"
+#include "SymbolTable.hpp"
+#include "detail/fan_out.hpp"
+#include "detail/service_record.hpp"
 #include "detail/traits.hpp"
 
 /** A broker error. */
@@ -26,26 +38,25 @@ class broker_error : public std::exception {
 };
 
 namespace detail {
+// Returns true if the name has no leading, trailing or duplicate dots.
+inline bool is_sanitized(boost::string_view name) noexcept {
+  return name.empty() ||
+         (name.front() != '.' && name.back() != '.' &&
+          name.find("..") == boost::string_view::npos);
+}
+
 // Removes leading and trailing and duplicate dots.
-static inline std::string sanitize_name(std::string name) {
-  if (name.empty()) {
-    return name;
-  }
-  auto it = name.begin();
-  auto dst_it = it;
-  bool found = true;
-  for (; it != name.end(); ++it) {
-    if (!found || *it != '.') {
-      *dst_it++ = *it;
-      found = false;
-    } else {
-      found = true;
+inline std::string sanitize_name(boost::string_view raw_name) {
+  std::string name;
+  name.reserve(raw_name.size());
+  for (auto c : raw_name) {
+    if (c != '.' || (!name.empty() && name.back() != '.')) {
+      name.push_back(c);
     }
   }
-  if (dst_it != name.begin() && *std::prev(dst_it) == '.') {
-    --dst_it;
+  if (!name.empty() && name.back() == '.') {
+    name.pop_back();
   }
-  name.erase(dst_it, name.end());
   return name;
 }
 }
@@ -53,14 +64,51 @@ static inline std::string sanitize_name(std::string name) {
 // Contains a directory of all services. ServiceDirectory does not allow
 // multiple services with the same name or service with the same name as the
 // group.
+//
+// Directory is a tree of groups and services. Names of all the nodes are
+// interned in the symbol table and every node is indexed by its symbol.
+// Every node keeps the ordered list of all services in its subtree, so that
+// the lookup of a group is a single hash lookup. The lists are updated in
+// place whenever a service is added or removed. Symbols are never removed
+// from the table, so that they stay valid when a service is removed and added
+// again.
 class ServiceDirectory {
  public:
+  enum class NodeType { Group, Service };
+
+  ServiceDirectory()
+      : root_(new Node(NodeType::Group, symbols_.intern(""), nullptr)) {
+    nodes_.emplace_back(root_.get());
+  }
+
+  ServiceDirectory(ServiceDirectory const &other)
+      : symbols_(other.symbols_),
+        root_(new Node(NodeType::Group, other.root_->symbol, nullptr)),
+        nodes_(other.nodes_.size(), nullptr),
+        removed_(other.removed_) {
+    nodes_[root_->symbol.id] = root_.get();
+    copy_children(*other.root_, *root_);
+  }
+
+  ServiceDirectory(ServiceDirectory &&) = default;
+
+  ServiceDirectory &operator=(ServiceDirectory other) {
+    std::swap(symbols_, other.symbols_);
+    std::swap(root_, other.root_);
+    std::swap(nodes_, other.nodes_);
+    std::swap(removed_, other.removed_);
+    return *this;
+  }
+
   // Add a service to the group. Service name should be
   // "group1.subgroup1.subgroup2.service_name". Any missing groups are created
   // automatically. To add a service with the same name as the group, the
-  // group must be deleted first.
-  void add_service(std::string const &raw_name) {
-    auto name = detail::sanitize_name(raw_name);
+  // group must be deleted first. Returns symbol of the service.
+  Symbol add_service(NameRef raw_name) {
+    if (raw_name.is_symbol()) {
+      return add_service(name(raw_name.symbol()));
+    }
+    auto name = detail::sanitize_name(raw_name.name());
     if (name.empty()) {
       throw broker_error("Service must have a name");
     }
@@ -71,95 +119,231 @@ class ServiceDirectory {
       throw broker_error("Service with this name already exists.");
     }
 
-    // Since the property_tree automatically generates missing nodes with empty
-    // property, we mark service nodes with "service" string
-    tree.put(name, "service");
+    // Find or create all the groups on the path
+    Node *node = root_.get();
+    std::size_t begin = 0;
+    for (auto end = name.find('.'); end != std::string::npos;
+         begin = end + 1, end = name.find('.', begin)) {
+      auto &child = node->children[name.substr(begin, end - begin)];
+      if (!child) {
+        child.reset(new Node(NodeType::Group,
+                             symbols_.intern({name.data(), end}), node));
+        index(*child);
+      } else if (child->type == NodeType::Service) {
+        throw broker_error("Service with this name already exists.");
+      }
+      node = child.get();
+    }
+
+    auto &service = node->children[name.substr(begin)];
+    service.reset(new Node(NodeType::Service, symbols_.intern(name), node));
+    service->services.emplace_back(service->symbol);
+    index(*service);
+
+    // Insert the symbol into the service lists of all the groups on the path
+    std::size_t position = 0;
+    for (Node *child = service.get(); child->parent; child = child->parent) {
+      position += offset(*child);
+      child->parent->services.insert(
+          child->parent->services.begin() + position, service->symbol);
+    }
+    compact();
+    return service->symbol;
   }
 
-  // Removes a service or a whole group with the given path. Empty groups are
-  // not removed automatically. To clean up the directory and remove empty
-  // groups, call "prune".
-  void remove_service(std::string const &raw_name) {
-    if (auto node = tree.get_child_optional(detail::sanitize_name(raw_name))) {
-      node->clear();
-      // node does not store its parent, therefore it is not possible to remove
-      // it from the tree. To delete a node we simply clear its contents and
-      // mark it deleted.
-      node->put_value("deleted");
+  // Removes a service or a whole group with the given path. Groups left
+  // without any service are removed as well.
+  void remove_service(NameRef raw_name) {
+    Node *node = find_node(raw_name);
+    if (!node) {
+      return;
+    }
+    if (!node->parent) {
+      clear();
+      return;
     }
+
+    // Erase the range of removed services from the service lists of all the
+    // groups on the path
+    const auto count = node->services.size();
+    std::size_t position = 0;
+    for (Node *child = node; child->parent; child = child->parent) {
+      position += offset(*child);
+      auto first = child->parent->services.begin() + position;
+      child->parent->services.erase(first, first + count);
+    }
+
+    Node *parent = node->parent;
+    erase(*node);
+    while (parent->parent && parent->children.empty()) {
+      node = parent;
+      parent = parent->parent;
+      erase(*node);
+    }
+    compact();
   }
 
   // Recursively list all services in the group. Does not include groups.
-  std::vector<std::string> list_services(
-      std::string const &raw_name = "") const {
+  std::vector<std::string> list_services(NameRef raw_name = "") const {
     std::vector<std::string> result;
-    auto name = detail::sanitize_name(raw_name);
-
-    auto node = tree.get_child_optional(name);
-    // No node with this name exists
-    if (!node) {
-      return result;
-    }
-    // Selected node is a service
-    if (node->data() == "service") {
-      result.emplace_back(name);
-      return result;
-    }
-
-    // Selected node is a group
-    using iterator_t = boost::property_tree::ptree::const_assoc_iterator;
-    std::stack<std::pair<iterator_t, iterator_t>> iterator_stack;
-    std::stack<std::string> name_stack;
-    // Correctly handle root nodes
-    name_stack.push(name == "" ? "" : name + ".");
-
-    // Walk through the tree. This implementation uses std::stack to store
-    // iterators. Alternative implementation would be possible with recursion.
-    auto it = node->ordered_begin();
-    auto it_end = node->not_found();
-    while (true) {
-      while (it != it_end) {
-        if (it->second.data() == "service") {
-          result.emplace_back(name_stack.top() + it->first);
-          ++it;
-        } else {
-          iterator_stack.emplace(it, it_end);
-          name_stack.push(name_stack.top() + it->first + ".");
-          it_end = it->second.not_found();
-          it = it->second.ordered_begin();
-        }
-      }
-      if (!iterator_stack.empty()) {
-        it = std::next(iterator_stack.top().first);
-        it_end = iterator_stack.top().second;
-        iterator_stack.pop();
-        name_stack.pop();
-      } else {
-        break;
-      }
+    auto const &service_symbols = services(raw_name);
+    result.reserve(service_symbols.size());
+    for (auto symbol : service_symbols) {
+      result.emplace_back(name(symbol));
     }
     return result;
   }
 
-  enum class NodeType { Group, Service };
+  // Same as list_services, but returns a reference to the list of symbols
+  // stored in the directory. The reference is invalidated by the next
+  // modification of the directory.
+  std::vector<Symbol> const &services(NameRef raw_name = "") const {
+    static const std::vector<Symbol> none;
+    auto node = find_node(raw_name);
+    return node ? node->services : none;
+  }
 
   // Return type of the given node in the directory (Group or Service). Returns
   // nullopt if no node exists.
-  boost::optional<NodeType> node_type(std::string const &raw_name) const {
-    auto node = tree.get_optional<std::string>(detail::sanitize_name(raw_name));
+  boost::optional<NodeType> node_type(NameRef raw_name) const {
+    if (auto node = find_node(raw_name)) {
+      return node->type;
+    }
+    return boost::none;
+  }
 
-    if (node && *node != "deleted") {
-      return *node == "" ? boost::make_optional(NodeType::Group)
-                         : boost::make_optional(NodeType::Service);
+  // Return symbol of the service or group, or none if no such node exists.
+  boost::optional<Symbol> find(NameRef raw_name) const {
+    if (auto node = find_node(raw_name)) {
+      return node->symbol;
     }
     return boost::none;
   }
 
+  // Return the name of the symbol
+  std::string const &name(Symbol symbol) const {
+    return symbols_.name(symbol);
+  }
+
   // Remove all elements from the directory
-  void clear() { tree.clear(); }
+  void clear() {
+    for (auto const &child : root_->children) {
+      unindex(*child.second);
+    }
+    root_->children.clear();
+    root_->services.clear();
+    compact();
+  }
+
+  // Number of names held by the directory, including the names of the
+  // removed nodes which were not compacted yet
+  std::size_t capacity() const noexcept { return symbols_.size(); }
 
  private:
-  boost::property_tree::ptree tree;
+  struct Node {
+    Node(NodeType type, Symbol symbol, Node *parent)
+        : type(type), symbol(symbol), parent(parent) {}
+
+    NodeType type;
+    // Full name of the node
+    Symbol symbol;
+    Node *parent;
+    // Child nodes ordered by their (last) name component
+    std::map<std::string, std::unique_ptr<Node>> children;
+    // All services in the subtree in the order of the depth first traversal
+    std::vector<Symbol> services;
+  };
+
+  // Find the node. Does not allocate if the name is already sanitized.
+  Node *find_node(NameRef raw_name) const {
+    if (raw_name.is_symbol()) {
+      return find_node(raw_name.symbol());
+    }
+    auto symbol = detail::is_sanitized(raw_name.name())
+                      ? symbols_.find(raw_name.name())
+                      : symbols_.find(detail::sanitize_name(raw_name.name()));
+    return symbol ? find_node(*symbol) : nullptr;
+  }
+
+  Node *find_node(Symbol symbol) const {
+    if (symbol.id >= nodes_.size()) {
+      return nullptr;
+    }
+    // The id may belong to a newer name, if the symbol was released
+    auto node = nodes_[symbol.id];
+    return node && node->symbol == symbol ? node : nullptr;
+  }
+
+  // Position of the node's services in the service list of its parent.
+  static std::size_t offset(Node const &node) {
+    std::size_t position = 0;
+    for (auto const &sibling : node.parent->children) {
+      if (sibling.second.get() == &node) {
+        break;
+      }
+      position += sibling.second->services.size();
+    }
+    return position;
+  }
+
+  void index(Node &node) {
+    if (nodes_.size() <= node.symbol.id) {
+      nodes_.resize(node.symbol.id + 1, nullptr);
+    }
+    nodes_[node.symbol.id] = &node;
+  }
+
+  // Remove the node and its subtree from the index. Their symbols are
+  // released later by compact.
+  void unindex(Node const &node) {
+    nodes_[node.symbol.id] = nullptr;
+    removed_.emplace_back(node.symbol);
+    for (auto const &child : node.children) {
+      unindex(*child.second);
+    }
+  }
+
+  // Remove the node and its subtree from the tree and from the index
+  void erase(Node &node) {
+    unindex(node);
+    auto const &name = symbols_.name(node.symbol);
+    node.parent->children.erase(name.substr(name.rfind('.') + 1));
+  }
+
+  // Release the symbols of the removed nodes, so that the names, the index
+  // and the service records do not grow with the number of names ever used.
+  // Symbols are kept for a while, since a removed service is often added
+  // again, and only a few of them are released per modification, so that
+  // removing a large group does not cause a long pause.
+  void compact() {
+    static constexpr std::size_t threshold = 1024;
+    static constexpr std::size_t batch = 4;
+    for (std::size_t i = 0; i < batch && removed_.size() > threshold; ++i) {
+      auto symbol = removed_.front();
+      removed_.pop_front();
+      // Skip the symbols which were added again
+      if (!nodes_[symbol.id]) {
+        symbols_.release(symbol);
+      }
+    }
+  }
+
+  void copy_children(Node const &from, Node &to) {
+    to.services = from.services;
+    for (auto const &child : from.children) {
+      auto &copy = to.children[child.first];
+      copy.reset(new Node(child.second->type, child.second->symbol, &to));
+      index(*copy);
+      copy_children(*child.second, *copy);
+    }
+  }
+
+  SymbolTable symbols_;
+  std::unique_ptr<Node> root_;
+  // Symbol -> node, nullptr if the node with the name does not exist
+  std::vector<Node *> nodes_;
+  // Symbols of the removed nodes, in the order of removal
+  std::deque<Symbol> removed_;
 };
 
 /** A service broker. Service broker brokers services amongst different
@@ -178,8 +362,12 @@ class ServiceBroker {
    */
   template <typename Result, typename... Args>
   void add_service(Service<Result, Args...> service) {
-    service_directory_.add_service(service.name);
-    services_[service.name] = service;
+    auto symbol = service_directory_.add_service(service.name);
+    if (services_.size() <= symbol.id) {
+      services_.resize(symbol.id + 1);
+    }
+    services_[symbol.id] = detail::service_record(service);
+    ++generation_;
   }
 
   /**
@@ -190,15 +378,15 @@ class ServiceBroker {
    @param name  Service name.
    @param group Service group.
    */
-  std::size_t remove_service(std::string const &name) {
-    auto service_names = service_directory_.list_services(name);
-    for (const auto &name : service_names) {
-      auto it = services_.find(name);
-      assert(it != services_.end());
-      services_.erase(it);
+  std::size_t remove_service(NameRef name) {
+    auto const &service_symbols = service_directory_.services(name);
+    const auto count = service_symbols.size();
+    for (auto symbol : service_symbols) {
+      services_[symbol.id] = detail::service_record();
     }
     service_directory_.remove_service(name);
-    return service_names.size();
+    ++generation_;
+    return count;
   }
 
   /**
@@ -208,26 +396,45 @@ class ServiceBroker {
    @param group             Service group.
    @param [in,out] callback The callback.
 
-   @return A std::vector&lt;boost::signals2::connection&gt;
+   @return A std::vector&lt;Connection&gt;
    */
   template <typename Function>
-  std::vector<boost::signals2::connection> register_callback(
-      std::string const &name, Function &&callback) {
-    std::vector<boost::signals2::connection> connections;
+  std::vector<Connection> register_callback(
+      NameRef name, Function &&callback) const {
+    std::vector<Connection> connections;
 
-    auto service_names = service_directory_.list_services(name);
-    if (service_names.empty()) {
+    auto const &service_symbols = service_directory_.services(name);
+    if (service_symbols.empty()) {
       throw broker_error(
           "Cannot register callback. No service or group with "
           "this name exists.");
     }
-    for (const auto &name : service_names) {
+    for (auto symbol : service_symbols) {
       connections.emplace_back(
-          register_callback_(name, std::forward<Function>(callback)));
+          register_callback_(symbol, std::forward<Function>(callback)));
     }
     return connections;
   }
 
+  /**
+   Register callback to all services in a group. The callback is called on the
+   policy's executor through its own mailbox, so that the services only
+   enqueue the arguments and do not wait for the callback. See queued.
+
+   @tparam Function Type of the callback, which must return void.
+   @param name     Service group.
+   @param callback The callback.
+   @param policy   Mailbox bound, overflow strategy and executor.
+
+   @return A std::vector&lt;Connection&gt;
+   */
+  template <typename Function>
+  std::vector<Connection> register_callback(NameRef name, Function &&callback,
+                                            DispatchPolicy policy) const {
+    return register_callback(
+        name, queued(std::forward<Function>(callback), std::move(policy)));
+  }
+
   /// @brief Call all services inside the directory 'name'.
   // Throws broker_error if name matches no service, or if the input
   // arguments are of invalid type. Function returns an array of results. If
@@ -243,15 +450,18 @@ class ServiceBroker {
   template <typename ResultType, typename... Args>
   typename std::enable_if_t<!std::is_void<ResultType>::value,
                             std::vector<ResultType>>
-  call(std::string const &name, Args &&... args) {
-    auto service_names = service_directory_.list_services(name);
-    if (service_names.empty()) {
+  call(NameRef name, Args &&... args) const {
+    // Symbols are copied, since the called services may modify the directory
+    auto const &found = service_directory_.services(name);
+    symbol_list service_symbols(found.begin(), found.end());
+    if (service_symbols.empty()) {
       throw broker_error("No service or group with this name exists.");
     }
     std::vector<ResultType> result;
-    for (const auto &name : service_names) {
+    result.reserve(service_symbols.size());
+    for (auto symbol : service_symbols) {
       result.emplace_back(
-          call_<ResultType, Args...>(name, std::forward<Args>(args)...));
+          call_<ResultType, Args...>(symbol, std::forward<Args>(args)...));
     }
     return result;
   }
@@ -268,9 +478,46 @@ class ServiceBroker {
   ///
   /// @return A combined result.
   template <typename ResultType, class Combiner, typename... Args>
-  typename std::enable_if_t<!std::is_void<ResultType>::value, ResultType>
-  call_combine(std::string const &name, Combiner &&combiner, Args &&... args) {
-    return combiner(call<ResultType>(name, std::forward<Args>(args)...));
+  typename std::enable_if_t<
+      !std::is_void<ResultType>::value &&
+          !detail::is_streaming_combiner<std::decay_t<Combiner>>::value,
+      ResultType>
+  call_combine(NameRef name, Combiner &&combiner,
+               Args &&... args) const {
+    return call_combine<ResultType>(
+        name, make_vector_combiner<ResultType>(std::forward<Combiner>(combiner)),
+        std::forward<Args>(args)...);
+  }
+
+  /// @brief Call all services inside the directory 'name' and combine the
+  /// results with the given streaming combiner.
+  // Each result is moved into the accumulator as the service returns. When
+  // the combiner's fold returns false, the remaining services are not called.
+  // See StreamingCombiner.hpp.
+  ///
+  /// @return Result of the combiner's finish.
+  template <typename ResultType, class Combiner, typename... Args>
+  typename std::enable_if_t<
+      !std::is_void<ResultType>::value &&
+          detail::is_streaming_combiner<std::decay_t<Combiner>>::value,
+      decltype(std::declval<Combiner &>().finish(
+          std::declval<Combiner &>().init()))>
+  call_combine(NameRef name, Combiner &&combiner,
+               Args &&... args) const {
+    // Symbols are copied, since the called services may modify the directory
+    auto const &found = service_directory_.services(name);
+    symbol_list service_symbols(found.begin(), found.end());
+    if (service_symbols.empty()) {
+      throw broker_error("No service or group with this name exists.");
+    }
+    auto accumulator = combiner.init();
+    for (auto symbol : service_symbols) {
+      if (!combiner.fold(accumulator, call_<ResultType, Args...>(
+                                          symbol, std::forward<Args>(args)...))) {
+        break;
+      }
+    }
+    return combiner.finish(std::move(accumulator));
   }
 
   /// @brief Call all services inside the directory 'name'.
@@ -284,14 +531,164 @@ class ServiceBroker {
   /// @param args Function call arguments
   template <typename ResultType, typename... Args>
   typename std::enable_if_t<std::is_void<ResultType>::value> call(
-      std::string const &name, Args &&... args) {
-    auto service_names = service_directory_.list_services(name);
-    if (service_names.empty()) {
+      NameRef name, Args &&... args) const {
+    // Symbols are copied, since the called services may modify the directory
+    auto const &found = service_directory_.services(name);
+    symbol_list service_symbols(found.begin(), found.end());
+    if (service_symbols.empty()) {
       throw broker_error("No service or group with this name exists.");
     }
-    for (const auto &name : service_names) {
-      call_<ResultType, Args...>(name, std::forward<Args>(args)...);
+    for (auto symbol : service_symbols) {
+      call_<ResultType, Args...>(symbol, std::forward<Args>(args)...);
+    }
+  }
+
+  /// @brief Call all services inside the directory 'name' asynchronously.
+  // Services are called on the broker's executor in the same order as with
+  // call, while the calling thread continues. Arguments are copied. Throws
+  // broker_error if name matches no service, or if the input arguments are of
+  // invalid type. Exceptions thrown by the services are stored in the future.
+  // Waiting for the future inside a service called on the same executor may
+  // deadlock.
+  ///
+  /// @tparam ResultType
+  /// @tparam Args
+  /// @param name Service name
+  /// @param args Function call arguments
+  ///
+  /// @return Future of an array of results.
+  template <typename ResultType, typename... Args>
+  typename std::enable_if_t<!std::is_void<ResultType>::value,
+                            std::future<std::vector<ResultType>>>
+  call_async(NameRef name, Args &&... args) const {
+    return call_async_<ResultType, Args...>(name, std::forward<Args>(args)...);
+  }
+
+  /// @brief Call all services inside the directory 'name' asynchronously.
+  // Specialization for services with void return type. See call_async.
+  template <typename ResultType, typename... Args>
+  typename std::enable_if_t<std::is_void<ResultType>::value, std::future<void>>
+  call_async(NameRef name, Args &&... args) const {
+    return call_async_<ResultType, Args...>(name, std::forward<Args>(args)...);
+  }
+
+  /// @brief Call all services inside the directory 'name' in parallel.
+  // Services are executed on the broker's executor, while the calling thread
+  // executes one of them and waits for the others. Throws broker_error if
+  // name matches no service, or if the input arguments are of invalid type,
+  // before any service is called. If services throw, the first exception is
+  // rethrown after all services have completed.
+  ///
+  /// @tparam ResultType
+  /// @tparam Args
+  /// @param name Service name
+  /// @param args Function call arguments
+  ///
+  /// @return An array of results in the same order as returned by call.
+  template <typename ResultType, typename... Args>
+  typename std::enable_if_t<!std::is_void<ResultType>::value,
+                            std::vector<ResultType>>
+  call_parallel(NameRef name, Args &&... args) const {
+    std::vector<boost::optional<ResultType>> results;
+    call_parallel_<ResultType, Args...>(
+        name,
+        [&results](std::size_t index, ResultType &&result) {
+          if (results.size() <= index) {
+            results.resize(index + 1);
+          }
+          results[index] = std::move(result);
+          return true;
+        },
+        std::forward<Args>(args)...);
+
+    std::vector<ResultType> result;
+    result.reserve(results.size());
+    for (auto &r : results) {
+      result.emplace_back(std::move(*r));
     }
+    return result;
+  }
+
+  /// @brief Call all services inside the directory 'name' in parallel.
+  // Specialization for services with void return type. See call_parallel.
+  template <typename ResultType, typename... Args>
+  typename std::enable_if_t<std::is_void<ResultType>::value> call_parallel(
+      NameRef name, Args &&... args) const {
+    call_parallel_<ResultType, Args...>(
+        name, [](std::size_t, bool) { return true; },
+        std::forward<Args>(args)...);
+  }
+
+  /// @brief Call all services inside the directory 'name' in parallel and
+  /// combine the results with the given Combiner. See call_parallel.
+  template <typename ResultType, class Combiner, typename... Args>
+  typename std::enable_if_t<
+      !std::is_void<ResultType>::value &&
+          !detail::is_streaming_combiner<std::decay_t<Combiner>>::value,
+      ResultType>
+  call_combine_parallel(NameRef name, Combiner &&combiner,
+                        Args &&... args) const {
+    return combiner(call_parallel<ResultType>(name, std::forward<Args>(args)...));
+  }
+
+  /// @brief Call all services inside the directory 'name' in parallel and
+  /// combine the results with the given streaming combiner.
+  // Results are folded on the calling thread in the order of completion. When
+  // the combiner's fold returns false, services which have not started yet
+  // are not called and the results of the running ones are ignored. See
+  // call_parallel.
+  template <typename ResultType, class Combiner, typename... Args>
+  typename std::enable_if_t<
+      !std::is_void<ResultType>::value &&
+          detail::is_streaming_combiner<std::decay_t<Combiner>>::value,
+      decltype(std::declval<Combiner &>().finish(
+          std::declval<Combiner &>().init()))>
+  call_combine_parallel(NameRef name, Combiner &&combiner,
+                        Args &&... args) const {
+    auto accumulator = combiner.init();
+    call_parallel_<ResultType, Args...>(
+        name,
+        [&accumulator, &combiner](std::size_t, ResultType &&result) {
+          return combiner.fold(accumulator, std::move(result));
+        },
+        std::forward<Args>(args)...);
+    return combiner.finish(std::move(accumulator));
+  }
+
+  /// @brief Call all services inside the directory 'name' in parallel and
+  /// reduce the results as they arrive.
+  // Each result is combined with the accumulator, accumulator =
+  // reduce(std::move(accumulator), std::move(result)), on the calling thread
+  // in the order of completion. See call_parallel.
+  ///
+  /// @param name    Service name
+  /// @param initial Initial value of the accumulator
+  /// @param reduce  Reduction function
+  /// @param args    Function call arguments
+  ///
+  /// @return The accumulator.
+  template <typename ResultType, typename Accumulator, class Reduce,
+            typename... Args>
+  Accumulator call_reduce_parallel(NameRef name, Accumulator initial,
+                                   Reduce &&reduce, Args &&... args) const {
+    call_parallel_<ResultType, Args...>(
+        name,
+        [&initial, &reduce](std::size_t, ResultType &&result) {
+          initial = reduce(std::move(initial), std::move(result));
+          return true;
+        },
+        std::forward<Args>(args)...);
+    return initial;
+  }
+
+  // Executor used by the parallel calls. Process-wide shared executor is used
+  // by default.
+  std::shared_ptr<Executor> executor() const {
+    return executor_ ? executor_ : Executor::shared();
+  }
+
+  void set_executor(std::shared_ptr<Executor> executor) {
+    executor_ = std::move(executor);
   }
 
   /**
@@ -307,29 +704,120 @@ class ServiceBroker {
    @return The service.
    */
   template <typename Result, typename... Args>
-  Service<Result, Args...> get_service(std::string const &name) {
-    auto it = services_.find(name);
-    if (it == services_.end()) {
+  Service<Result, Args...> get_service(NameRef name) const {
+    auto record = find_record(name);
+    if (!record) {
       throw broker_error("Service does not exist.");
     }
 
-    try {
-      return boost::any_cast<Service<Result, Args...>>(it->second);
-    } catch (boost::bad_any_cast &) {
-      throw broker_error("Type mismatch.");
+    if (auto service = record->template get<Service<Result, Args...>>()) {
+      return *service;
     }
+    throw broker_error("Type mismatch.");
   }
 
-  std::vector<std::string> list_services(std::string const &name = "") const {
+  /**
+   Find a service without copying it.
+
+   @tparam Result Type of the result.
+   @tparam Args   Type of the arguments.
+   @param name  Service name.
+
+   @return Pointer to the service, which is valid until the service is
+   removed, or nullptr if the service does not exist or if the types do not
+   match.
+   */
+  template <typename Result, typename... Args>
+  Service<Result, Args...> const *find_service(NameRef name) const {
+    auto record = find_record(name);
+    return record ? record->template get<Service<Result, Args...>>() : nullptr;
+  }
+
+  std::vector<std::string> list_services(NameRef name = "") const {
     return service_directory_.list_services(name);
   }
 
+  /**
+   Get the symbol of a service or group. Symbols can be passed to all the
+   functions instead of names, which avoids the name lookup. Symbol stays
+   valid until the service or group is removed. Removed names are released
+   and their ids reused, so a stale symbol never refers to another service,
+   but it need not refer to the service once it is added again. Callers
+   re-resolve a stale symbol.
+
+   @return Symbol of the service or group or none, if no such service or
+   group exists.
+   */
+  boost::optional<Symbol> symbol(NameRef name) const {
+    return service_directory_.find(name);
+  }
+
+  // Return the name of the symbol
+  std::string const &name(Symbol symbol) const {
+    return service_directory_.name(symbol);
+  }
+
+  /**
+   Resolve all services inside the directory 'name' to a handle, which can be
+   called repeatedly without looking up the services. Handle is refreshed
+   automatically when services are added or removed.
+
+   @exception broker_error Thrown when name matches no service or when the
+   service types do not match.
+
+   @tparam ResultType Type of the result.
+   @tparam Args       Type of the arguments.
+   @param name Service or group name.
+
+   @return A handle to the services.
+   */
+  template <typename ResultType, typename... Args>
+  ServiceHandleT<ServiceBroker, ResultType, Args...> resolve(NameRef name) {
+    return {*this, name};
+  }
+
+  /**
+   Get all services inside the directory 'name'.
+
+   @exception broker_error Thrown when name matches no service or when the
+   service types do not match.
+   */
+  template <typename ResultType, typename... Args>
+  std::vector<Service<ResultType, Args...>> resolve_services(
+      NameRef name) const {
+    auto const &service_symbols = service_directory_.services(name);
+    if (service_symbols.empty()) {
+      throw broker_error("No service or group with this name exists.");
+    }
+    std::vector<Service<ResultType, Args...>> result;
+    result.reserve(service_symbols.size());
+    for (auto symbol : service_symbols) {
+      auto service =
+          services_[symbol.id].template get<Service<ResultType, Args...>>();
+      if (!service) {
+        throw broker_error("Cannot resolve: " + this->name(symbol) +
+                           ". Type mismatch.");
+      }
+      result.emplace_back(*service);
+    }
+    return result;
+  }
+
+  // Generation is incremented on every modification of the services
+  std::size_t generation() const noexcept { return generation_; }
+
+  // Number of names held by the broker. See ServiceDirectory::capacity.
+  std::size_t capacity() const noexcept {
+    return service_directory_.capacity();
+  }
+
   /**
    Clear all services
    */
   void clear() {
     service_directory_.clear();
     services_.clear();
+    ++generation_;
   }
 
  private:
@@ -344,56 +832,48 @@ class ServiceBroker {
    @param group             Service group.
    @param [in,out] callback The callback.
 
-   @return A boost::signals2::connection.
+   @return A Connection.
    */
   template <typename Function>
-  boost::signals2::connection register_callback_(std::string const &name,
-                                                 Function &&callback) {
-    auto it = services_.find(name);
-    assert(it != services_.end());
-
+  Connection register_callback_(Symbol symbol,
+                                                 Function &&callback) const {
     using callback_traits = typename utils::function_traits<decltype(callback)>;
 
-    try {
-      return connect(it->second, std::forward<Function>(callback),
-                     typename gens<callback_traits::arity>::type());
-    } catch (boost::bad_any_cast &) {
-      std::string error =
-          "Cannot register callback to service: " + name + ". Type mismatch.";
+    auto connection =
+        connect(services_[symbol.id], std::forward<Function>(callback),
+                typename gens<callback_traits::arity>::type());
+    if (!connection) {
+      std::string error = "Cannot register callback to service: " +
+                          name(symbol) + ". Type mismatch.";
       throw broker_error(error.c_str());
     }
+    return *connection;
   }
 
   // Specialization for void return type returning nothing
   template <typename ResultType, typename... Args>
   typename std::enable_if_t<std::is_void<ResultType>::value> call_(
-      std::string const &name, Args &&... args) {
-    auto it = services_.find(name);
-    assert(it != services_.end());
-
-    try {
-      boost::any_cast<Service<ResultType, Args...>>(it->second)(
-          std::forward<Args>(args)...);
-    } catch (boost::bad_any_cast &) {
-      std::string error = "Cannot call: " + name + ". Type mismatch.";
+      Symbol symbol, Args &&... args) const {
+    auto service =
+        services_[symbol.id].template get<Service<ResultType, Args...>>();
+    if (!service) {
+      std::string error = "Cannot call: " + name(symbol) + ". Type mismatch.";
       throw broker_error(error.c_str());
     }
+    (*service)(std::forward<Args>(args)...);
   }
 
   // Specialization for all calls that are not void returning ReturnType
   template <typename ResultType, typename... Args>
   typename std::enable_if_t<!std::is_void<ResultType>::value, ResultType> call_(
-      std::string const &name, Args &&... args) {
-    auto it = services_.find(name);
-    assert(it != services_.end());
-
-    try {
-      return boost::any_cast<Service<ResultType, Args...>>(it->second)(
-          std::forward<Args>(args)...);
-    } catch (boost::bad_any_cast &) {
-      std::string error = "Cannot call: " + name + ". Type mismatch.";
+      Symbol symbol, Args &&... args) const {
+    auto service =
+        services_[symbol.id].template get<Service<ResultType, Args...>>();
+    if (!service) {
+      std::string error = "Cannot call: " + name(symbol) + ". Type mismatch.";
       throw broker_error(error.c_str());
     }
+    return (*service)(std::forward<Args>(args)...);
   }
 
   // Several helper function to generate integer sequence for parameter
@@ -407,23 +887,147 @@ class ServiceBroker {
     typedef seq<S...> type;
   };
 
-  /** Connect service to callback.  */
+  /** Connect service to callback. Returns none if the types do not match. */
   template <typename Function, int... S>
-  boost::signals2::connection connect(boost::any &service, Function &&callback,
-                                      seq<S...>) {
+  boost::optional<Connection> connect(
+      detail::service_record const &record, Function &&callback,
+      seq<S...>) const {
     using callback_traits = typename utils::function_traits<decltype(callback)>;
 
-    return boost::any_cast<Service<typename callback_traits::result_type,
-                                   typename callback_traits::template arg<S>::type...>>(
-               service)
-        .service->connect(callback);
+    auto service = record.template get<
+        Service<typename callback_traits::result_type,
+                typename callback_traits::template arg<S>::type...>>();
+    if (!service) {
+      return boost::none;
+    }
+    return service->service->connect(callback);
+  }
+
+  // Record of the service, or nullptr if the service does not exist
+  detail::service_record const *find_record(NameRef name) const {
+    auto symbol = service_directory_.find(name);
+    if (!symbol || symbol->id >= services_.size() ||
+        !services_[symbol->id].type()) {
+      return nullptr;
+    }
+    return &services_[symbol->id];
   }
 
+  // Records of the services being called asynchronously or in parallel
+  using record_list =
+      boost::container::small_vector<detail::service_record, 16>;
+
+  // Records of all services inside the directory 'name'. All services are
+  // resolved before calling any of them. Records are copied, since the
+  // called services may modify the broker.
+  template <typename ServiceT>
+  record_list resolve_records_(NameRef name) const {
+    record_list records;
+    for (auto symbol : service_directory_.services(name)) {
+      if (!services_[symbol.id].template get<ServiceT>()) {
+        throw broker_error("Cannot call: " + this->name(symbol) +
+                           ". Type mismatch.");
+      }
+      records.emplace_back(services_[symbol.id]);
+    }
+    if (records.empty()) {
+      throw broker_error("No service or group with this name exists.");
+    }
+    return records;
+  }
+
+  // Call the services of the records with the arguments stored in a tuple
+  template <typename ResultType, typename ServiceT, typename Tuple, int... S>
+  static std::enable_if_t<!std::is_void<ResultType>::value,
+                          std::vector<ResultType>>
+  call_records_(record_list const &records, Tuple &args, seq<S...>) {
+    std::vector<ResultType> result;
+    result.reserve(records.size());
+    for (auto const &record : records) {
+      result.emplace_back(
+          (*record.template get<ServiceT>())(std::get<S>(args)...));
+    }
+    return result;
+  }
+
+  template <typename ResultType, typename ServiceT, typename Tuple, int... S>
+  static std::enable_if_t<std::is_void<ResultType>::value> call_records_(
+      record_list const &records, Tuple &args, seq<S...>) {
+    for (auto const &record : records) {
+      (*record.template get<ServiceT>())(std::get<S>(args)...);
+    }
+  }
+
+  template <typename ResultType, typename... Args>
+  decltype(auto) call_async_(NameRef name, Args &&... args) const {
+    using service_type = Service<ResultType, Args...>;
+    return executor()->async(
+        [records = resolve_records_<service_type>(name),
+         arguments = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+          return call_records_<ResultType, service_type>(
+              records, arguments, typename gens<sizeof...(Args)>::type());
+        });
+  }
+
+  // Call the services on the executor and pass the results to the
+  // consumer as they arrive. Results of void services are passed as true.
+  template <typename ResultType, typename... Args, typename Consumer>
+  void call_parallel_(NameRef name, Consumer &&consumer,
+                      Args &&... args) const {
+    using service_type = Service<ResultType, Args...>;
+    using value_type =
+        std::conditional_t<std::is_void<ResultType>::value, bool, ResultType>;
+
+    auto records = resolve_records_<service_type>(name);
+    auto executor = this->executor();
+    detail::fan_out<value_type> tasks(*executor);
+    for (std::size_t i = 1; i < records.size(); ++i) {
+      auto service = records[i].template get<service_type>();
+      tasks.submit(i, [service, &args...]() {
+        return invoke_<value_type>(*service, args...);
+      });
+    }
+    auto service = records.front().template get<service_type>();
+    tasks.run(0, [service, &args...]() {
+      return invoke_<value_type>(*service, args...);
+    });
+    tasks.consume(std::forward<Consumer>(consumer));
+  }
+
+  template <typename ValueType, typename ServiceT, typename... Args>
+  static std::enable_if_t<std::is_same<ValueType, bool>::value &&
+                              std::is_void<typename ServiceT::result_type>::value,
+                          bool>
+  invoke_(ServiceT const &service, Args const &... args) {
+    service(args...);
+    return true;
+  }
+
+  template <typename ValueType, typename ServiceT, typename... Args>
+  static std::enable_if_t<!std::is_void<typename ServiceT::result_type>::value,
+                          ValueType>
+  invoke_(ServiceT const &service, Args const &... args) {
+    return service(args...);
+  }
+
+  // Symbols of the services being called. Most groups fit into the inline
+  // storage, so that calls do not allocate.
+  using symbol_list = boost::container::small_vector<Symbol, 16>;
+
   ServiceDirectory service_directory_;
 
-  // name -> Service stored in boost::any.
-  std::unordered_map<std::string, boost::any> services_;
+  // Executor for parallel calls, Executor::shared() if not set
+  std::shared_ptr<Executor> executor_;
+
+  // Symbol -> type-erased Service. Records of the removed services and of the
+  // groups are empty.
+  std::vector<detail::service_record> services_;
+
+  std::size_t generation_ = 0;
 };
 
+template <typename ResultType, typename... Args>
+using ServiceHandle = ServiceHandleT<ServiceBroker, ResultType, Args...>;
+
 ServiceBroker &get_broker();
 #endif
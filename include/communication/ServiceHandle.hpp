@@ -0,0 +1,135 @@
+#ifndef SERVICE_HANDLE_HPP
+#define SERVICE_HANDLE_HPP
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <type_traits>
+
+#include "Service.hpp"
+#include "StreamingCombiner.hpp"
+#include "SymbolTable.hpp"
+
+/** A pre-resolved service or group of services. Handle keeps the services
+ * resolved by the broker, so that calling them requires no name lookup and no
+ * type check. Broker increments its generation whenever a service is added or
+ * removed; handle compares the generations on each call and resolves the
+ * services again if they differ. Broker must outlive the handle. */
+template <typename BrokerType, typename ResultType, typename... Args>
+class ServiceHandleT {
+ public:
+  using broker_type = BrokerType;
+  using result_type = ResultType;
+  using service_type = Service<ResultType, Args...>;
+
+ public:
+  /**
+   Resolve services.
+
+   @exception broker_error Thrown when name matches no service or when the
+   service types do not match.
+   */
+  ServiceHandleT(BrokerType &broker, NameRef name)
+      : broker_(&broker),
+        generation_(broker.generation()),
+        services_(broker.template resolve_services<ResultType, Args...>(name)),
+        symbol_(*broker.symbol(name)),
+        name_(broker.name(symbol_)) {}
+
+  // Returns false if the broker was modified since the services were resolved
+  bool valid() const noexcept { return generation_ == broker_->generation(); }
+
+  // Resolve the services again
+  void refresh() {
+    auto generation = broker_->generation();
+    if (broker_->symbol(symbol_)) {
+      services_ =
+          broker_->template resolve_services<ResultType, Args...>(symbol_);
+    } else {
+      // The group was removed. It may have been added again with a new symbol.
+      services_ =
+          broker_->template resolve_services<ResultType, Args...>(name_);
+      symbol_ = *broker_->symbol(name_);
+    }
+    generation_ = generation;
+  }
+
+  // Return resolved services. Refreshes the handle if necessary.
+  std::vector<service_type> const &services() {
+    update();
+    return services_;
+  }
+
+  // Symbol of the resolved service or group
+  Symbol symbol() const noexcept { return symbol_; }
+
+  /// @brief Call all resolved services and return an array of results.
+  template <typename R = ResultType>
+  std::enable_if_t<!std::is_void<R>::value, std::vector<R>> operator()(
+      Args const &... args) {
+    update();
+    std::vector<ResultType> result;
+    result.reserve(services_.size());
+    for (auto &service : services_) {
+      result.emplace_back(service(args...));
+    }
+    return result;
+  }
+
+  /// @brief Call all resolved services. Specialization for services with void
+  /// return type.
+  template <typename R = ResultType>
+  std::enable_if_t<std::is_void<R>::value> operator()(Args const &... args) {
+    update();
+    for (auto &service : services_) {
+      service(args...);
+    }
+  }
+
+  /// @brief Call all resolved services and combine the results with the given
+  /// Combiner.
+  template <typename Combiner, typename R = ResultType>
+  std::enable_if_t<!std::is_void<R>::value &&
+                       !detail::is_streaming_combiner<
+                           std::decay_t<Combiner>>::value,
+                   R>
+  combine(Combiner &&combiner, Args const &... args) {
+    return combiner(operator()(args...));
+  }
+
+  /// @brief Call the resolved services and combine the results with the given
+  /// streaming combiner. See StreamingCombiner.hpp.
+  template <typename Combiner, typename R = ResultType>
+  std::enable_if_t<
+      !std::is_void<R>::value &&
+          detail::is_streaming_combiner<std::decay_t<Combiner>>::value,
+      decltype(std::declval<Combiner &>().finish(
+          std::declval<Combiner &>().init()))>
+  combine(Combiner &&combiner, Args const &... args) {
+    update();
+    auto accumulator = combiner.init();
+    for (auto &service : services_) {
+      if (!combiner.fold(accumulator, service(args...))) {
+        break;
+      }
+    }
+    return combiner.finish(std::move(accumulator));
+  }
+
+ private:
+  void update() {
+    if (!valid()) {
+      refresh();
+    }
+  }
+
+  BrokerType *broker_;
+  // Broker's generation at the time of resolving
+  std::size_t generation_;
+  std::vector<service_type> services_;
+  Symbol symbol_;
+  std::string name_;
+};
+
+#endif
@@ -0,0 +1,317 @@
+#ifndef SHARED_CONTEXT_EXECUTOR_HPP
+#define SHARED_CONTEXT_EXECUTOR_HPP
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <threadpool/PerformanceStatistics.hpp>
+#include <threadpool/ThreadedQueue.hpp>
+
+#include "ContextExecutor.hpp"
+#include "Executor.hpp"
+#include "Tracing.hpp"
+#include "detail/noncopyable.hpp"
+
+/** Same interface as ContextExecutor, but executes the tasks on a shared
+ * Executor instead of its own threads. Number of executors is the number of
+ * contexts, which limits the number of tasks executing at the same time. Each
+ * context is used by one task at a time. Adaptive options and placement are
+ * ignored, since the threads belong to the shared executor. */
+template <typename ContextType>
+class SharedContextExecutor : noncopyable {
+ public:
+  using context_type = ContextType;
+  using argument_type = typename ContextType::argument_type;
+  using result_type = typename ContextType::result_type;
+
+  explicit SharedContextExecutor(
+      ExecutorOptions options = ExecutorOptions(),
+      std::shared_ptr<Executor> executor = Executor::shared())
+      : executor_(std::move(executor)), options_(options) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    add_contexts_(std::max<std::size_t>(options_.executors, 1u));
+  }
+
+  // Executes all scheduled tasks. Must not be destroyed from the threads of
+  // the executor.
+  ~SharedContextExecutor() {
+    std::unique_lock<std::mutex> lk(mtx_);
+    idle_.wait(lk, [this]() { return tasks_.empty() && drains_ == 0; });
+  }
+
+  // Schedule task for execution. Tasks are numbered in the order of
+  // scheduling, starting with 0. Origin is the time the work which produced
+  // the task arrived at the worker and trace the trace it belongs to. While
+  // the number of pending tasks is at the limit, the calling thread executes
+  // the tasks of the executor.
+  void schedule_task(argument_type const &arg,
+                     std::chrono::steady_clock::time_point origin =
+                         std::chrono::steady_clock::now(),
+                     TraceContext trace = tracing::current()) {
+    task_state task;
+    task.origin = origin;
+    task.trace = trace;
+    task.function = std::packaged_task<result_type(context_type &)>(
+        [this, arg, origin, trace](context_type &context) {
+          tracing::scoped_context trace_context(trace);
+          auto start_time = clock::now();
+          auto result = context(arg);
+          if (on_timing_) {
+            on_timing_({origin, start_time, clock::now(), trace});
+          }
+          return result;
+        });
+    std::shared_ptr<context_type> context;
+    {
+      std::unique_lock<std::mutex> lk(mtx_);
+      while (full_()) {
+        lk.unlock();
+        bool executed = executor_->try_run_one();
+        lk.lock();
+        if (!executed) {
+          not_full_.wait_for(lk, std::chrono::milliseconds(1),
+                             [this]() { return !full_(); });
+        }
+      }
+      task.sequence = scheduled_++;
+      task.ordered = options_.ordered;
+      if (task.ordered) {
+        result_queue.push_back({task.sequence, task.function.get_future(),
+                                task.origin, task.trace});
+      }
+      tasks_.emplace_back(std::move(task));
+      context = take_context_();
+    }
+    if (context) {
+      submit_(std::move(context));
+    }
+  }
+
+  // Change the number of executors. Contexts are removed once they finish
+  // their current task.
+  void set_options(ExecutorOptions options) {
+    std::vector<std::shared_ptr<context_type>> started;
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      options_ = options;
+      auto executors = std::max<std::size_t>(options_.executors, 1u);
+      auto current = contexts_.size() - surplus_;
+      if (executors > current) {
+        auto added = executors - current;
+        auto kept = std::min(surplus_, added);
+        surplus_ -= kept;
+        add_contexts_(added - kept);
+      } else {
+        surplus_ += current - executors;
+        while (surplus_ > 0 && !idle_contexts_.empty()) {
+          remove_context_(idle_contexts_.back());
+          idle_contexts_.pop_back();
+          --surplus_;
+        }
+      }
+      while (auto context = take_context_()) {
+        started.emplace_back(std::move(context));
+      }
+    }
+    not_full_.notify_all();
+    for (auto &context : started) {
+      submit_(std::move(context));
+    }
+  }
+
+  ExecutorOptions options() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return options_;
+  }
+
+  // Call function for all contexts and for all contexts added later
+  void configure(std::function<void(context_type &)> function) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    for (auto &context : contexts_) {
+      function(*context);
+    }
+    configure_ = std::move(function);
+  }
+
+  // Call function after each task completes, on the thread which executed
+  // the task. Must be set before the tasks are scheduled.
+  void set_on_complete(std::function<void()> function) {
+    on_complete_ = std::move(function);
+  }
+
+  // Call function with the timing of each task before its result is ready,
+  // on the thread which executed the task. Must be set before the tasks are
+  // scheduled.
+  void set_on_timing(std::function<void(TaskTiming const &)> function) {
+    on_timing_ = std::move(function);
+  }
+
+  std::vector<std::shared_ptr<context_type>> contexts() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return contexts_;
+  }
+
+  // Threads belong to the shared executor
+  std::vector<ThreadPlacement> topology(std::string const &) const {
+    return {};
+  }
+
+  // Number of executors
+  std::size_t size() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return contexts_.size() - surplus_;
+  }
+
+  // Number of scheduled tasks which have not completed yet
+  std::size_t pending() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return tasks_.size() + running_;
+  }
+
+  PerformanceStatistics performance_statistics() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return timings_;
+  }
+
+  // Futures of the results with the sequence numbers of their tasks
+  threaded_queue<ScheduledResult<result_type>> result_queue;
+
+ private:
+  using clock = std::chrono::steady_clock;
+
+  struct task_state {
+    std::size_t sequence;
+    // Result was pushed to the result queue when the task was scheduled
+    bool ordered;
+    clock::time_point origin;
+    TraceContext trace;
+    std::packaged_task<result_type(context_type &)> function;
+  };
+
+  // Tasks executed in a context before the thread is yielded to the other
+  // tasks of the executor
+  static constexpr std::size_t budget = 16;
+
+  void submit_(std::shared_ptr<context_type> context) {
+    executor_->submit([this, context]() { drain_(context); });
+  }
+
+  // Execute the scheduled tasks in the context, until there are none left
+  void drain_(std::shared_ptr<context_type> const &context) {
+    for (std::size_t i = 0; i < budget; ++i) {
+      std::unique_lock<std::mutex> lk(mtx_);
+      if (tasks_.empty() || surplus_ > 0) {
+        if (surplus_ > 0) {
+          --surplus_;
+          remove_context_(context);
+        } else {
+          idle_contexts_.emplace_back(context);
+        }
+        --drains_;
+        idle_.notify_all();
+        return;
+      }
+      auto task = std::move(tasks_.front());
+      tasks_.pop_front();
+      ++running_;
+      lk.unlock();
+
+      // Result of an unordered task is returned once it is ready
+      std::future<result_type> result;
+      if (!task.ordered) {
+        result = task.function.get_future();
+      }
+      auto start_time = clock::now();
+      task.function(*context);
+      auto duration = clock::now() - start_time;
+      if (!task.ordered) {
+        result_queue.push_back(
+            {task.sequence, std::move(result), task.origin, task.trace});
+      }
+      if (on_complete_) {
+        on_complete_();
+      }
+
+      lk.lock();
+      --running_;
+      timings_.update(duration);
+      not_full_.notify_one();
+    }
+    submit_(context);
+  }
+
+  // Take an idle context if there is a queued task which no context will
+  // take otherwise. Must be called with the mutex locked.
+  std::shared_ptr<context_type> take_context_() {
+    if (idle_contexts_.empty() || drains_ - running_ >= tasks_.size()) {
+      return nullptr;
+    }
+    auto context = std::move(idle_contexts_.back());
+    idle_contexts_.pop_back();
+    ++drains_;
+    return context;
+  }
+
+  // Must be called with the mutex locked
+  void add_contexts_(std::size_t count) {
+    for (std::size_t i = 0; i < count; ++i) {
+      auto context = std::make_shared<context_type>();
+      if (configure_) {
+        configure_(*context);
+      }
+      contexts_.emplace_back(context);
+      idle_contexts_.emplace_back(std::move(context));
+    }
+  }
+
+  // Must be called with the mutex locked
+  void remove_context_(std::shared_ptr<context_type> const &context) {
+    contexts_.erase(std::find(contexts_.begin(), contexts_.end(), context));
+  }
+
+  // Must be called with the mutex locked
+  bool full_() const {
+    return options_.max_pending != 0 &&
+           tasks_.size() + running_ >= options_.max_pending;
+  }
+
+  std::shared_ptr<Executor> executor_;
+
+  mutable std::mutex mtx_;
+  // Notified when a task completes
+  std::condition_variable not_full_;
+  // Notified when a context becomes idle
+  std::condition_variable idle_;
+  std::deque<task_state> tasks_;
+  // Number of scheduled tasks
+  std::size_t scheduled_ = 0;
+
+  ExecutorOptions options_;
+  std::function<void(context_type &)> configure_;
+  std::function<void()> on_complete_;
+  std::function<void(TaskTiming const &)> on_timing_;
+
+  // All contexts, including the ones which are in use by the tasks
+  std::vector<std::shared_ptr<context_type>> contexts_;
+  std::vector<std::shared_ptr<context_type>> idle_contexts_;
+  // Number of contexts which should be removed
+  std::size_t surplus_ = 0;
+  // Number of contexts in use by the tasks of the executor
+  std::size_t drains_ = 0;
+  // Number of tasks being executed
+  std::size_t running_ = 0;
+
+  PerformanceStatistics timings_;
+};
+
+#endif
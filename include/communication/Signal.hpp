@@ -0,0 +1,205 @@
+#ifndef SIGNAL_HPP
+#define SIGNAL_HPP
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+#include "detail/epoch.hpp"
+#include "detail/noncopyable.hpp"
+
+namespace detail {
+struct signal_slot_base {
+  signal_slot_base() : connected(true) {}
+  virtual ~signal_slot_base() = default;
+
+  std::atomic<bool> connected;
+};
+
+struct signal_state_base {
+  virtual ~signal_state_base() = default;
+  // Remove the slot from the slot list
+  virtual void remove(signal_slot_base const *slot) = 0;
+};
+}
+
+/** Connection between a Signal and a slot. Same as boost::signals2::connection,
+ * connection may outlive both the signal and the slot. */
+class SignalConnection {
+ public:
+  SignalConnection() = default;
+  SignalConnection(std::weak_ptr<detail::signal_state_base> state,
+                   std::weak_ptr<detail::signal_slot_base> slot)
+      : state_(std::move(state)), slot_(std::move(slot)) {}
+
+  // Disconnect the slot. The slot is not called by any emission which starts
+  // after disconnect, including the emissions which are already running but
+  // did not reach the slot yet.
+  void disconnect() const {
+    auto slot = slot_.lock();
+    if (!slot || !slot->connected.exchange(false)) {
+      return;
+    }
+    if (auto state = state_.lock()) {
+      state->remove(slot.get());
+    }
+  }
+
+  bool connected() const noexcept {
+    auto slot = slot_.lock();
+    return slot && slot->connected;
+  }
+
+ private:
+  std::weak_ptr<detail::signal_state_base> state_;
+  std::weak_ptr<detail::signal_slot_base> slot_;
+};
+
+template <typename Signature>
+class Signal;
+
+/** Signal with the same interface and semantics as boost::signals2::signal
+ * with the default combiner, which returns the result of the last slot.
+ * Emission takes no lock and makes no allocation: slots are kept in an
+ * immutable list, which is copied on connect and disconnect and deleted once
+ * no emission uses it anymore (see detail::epoch). Slots connected during an
+ * emission are called by the following emissions. */
+template <typename ResultType, typename... Args>
+class Signal<ResultType(Args...)> : noncopyable {
+ public:
+  using result_type = typename std::conditional<std::is_void<ResultType>::value,
+                                                void,
+                                                boost::optional<ResultType>>::type;
+  using slot_type = std::function<ResultType(Args...)>;
+
+  Signal() : state_(std::make_shared<state>()) {}
+
+  // Disconnects all slots, so that the connections report them as
+  // disconnected
+  ~Signal() { disconnect_all_slots(); }
+
+  SignalConnection connect(slot_type function) {
+    auto s = std::make_shared<slot>(std::move(function));
+    std::lock_guard<std::mutex> lk(state_->mtx);
+    auto next = copy();
+    next->emplace_back(s);
+    state_->slots.store(std::move(next));
+    return {state_, s};
+  }
+
+  void disconnect_all_slots() {
+    std::lock_guard<std::mutex> lk(state_->mtx);
+    detail::epoch_guard guard;
+    for (auto const &s : *state_->slots.load()) {
+      s->connected = false;
+    }
+    state_->slots.store(std::unique_ptr<slot_list>(new slot_list));
+  }
+
+  bool empty() const noexcept { return num_slots() == 0; }
+
+  std::size_t num_slots() const noexcept {
+    detail::epoch_guard guard;
+    return state_->slots.load()->size();
+  }
+
+  // Call all connected slots in the order of connection. Returns the result
+  // of the last called slot, or none if no slot was called.
+  result_type operator()(Args const &... args) const {
+    detail::epoch_guard guard;
+    return call_slots<ResultType>(*state_->slots.load(), args...);
+  }
+
+  // Same as operator(), but the arguments are moved into the last connected
+  // slot. Other slots receive copies, so a single subscriber receives the
+  // payload without any copy.
+  result_type emit(Args &&... args) const {
+    detail::epoch_guard guard;
+    auto const &slots = *state_->slots.load();
+    auto last = slots.size();
+    while (last > 0 && !slots[last - 1]->connected) {
+      --last;
+    }
+    if (last == 0) {
+      return result_type();
+    }
+    call_slots(slots, last - 1, args...);
+    return static_cast<result_type>(
+        slots[last - 1]->function(std::forward<Args>(args)...));
+  }
+
+ private:
+  struct slot : detail::signal_slot_base {
+    explicit slot(slot_type function) : function(std::move(function)) {}
+    slot_type function;
+  };
+
+  using slot_list = std::vector<std::shared_ptr<slot>>;
+
+  struct state : detail::signal_state_base {
+    state() : slots(std::unique_ptr<slot_list>(new slot_list)) {}
+
+    void remove(detail::signal_slot_base const *s) override {
+      std::lock_guard<std::mutex> lk(mtx);
+      detail::epoch_guard guard;
+      auto const &current = *slots.load();
+      std::unique_ptr<slot_list> next(new slot_list);
+      next->reserve(current.size());
+      for (auto const &other : current) {
+        if (other.get() != s) {
+          next->emplace_back(other);
+        }
+      }
+      slots.store(std::move(next));
+    }
+
+    // Current list of slots
+    detail::rcu_ptr<slot_list> slots;
+    // Serializes modifications
+    std::mutex mtx;
+  };
+
+  // Copy of the current slot list. Must be called with the mutex locked.
+  std::unique_ptr<slot_list> copy() const {
+    detail::epoch_guard guard;
+    return std::unique_ptr<slot_list>(new slot_list(*state_->slots.load()));
+  }
+
+  // Call the first count slots and ignore their results
+  static void call_slots(slot_list const &slots, std::size_t count,
+                         Args const &... args) {
+    for (std::size_t i = 0; i < count; ++i) {
+      if (slots[i]->connected.load(std::memory_order_acquire)) {
+        slots[i]->function(args...);
+      }
+    }
+  }
+
+  template <typename R>
+  static std::enable_if_t<std::is_void<R>::value> call_slots(
+      slot_list const &slots, Args const &... args) {
+    call_slots(slots, slots.size(), args...);
+  }
+
+  template <typename R>
+  static std::enable_if_t<!std::is_void<R>::value, boost::optional<R>>
+  call_slots(slot_list const &slots, Args const &... args) {
+    boost::optional<R> result;
+    for (auto const &s : slots) {
+      if (s->connected.load(std::memory_order_acquire)) {
+        result = s->function(args...);
+      }
+    }
+    return result;
+  }
+
+  std::shared_ptr<state> state_;
+};
+
+#endif
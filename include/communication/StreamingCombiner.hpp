@@ -0,0 +1,134 @@
+#ifndef STREAMING_COMBINER_HPP
+#define STREAMING_COMBINER_HPP
+
+#pragma once
+
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+/** Streaming combiners combine the results of a group call one at a time, as
+ * each service returns, without collecting them into a vector first. A
+ * streaming combiner for services returning ResultType provides:
+ *
+ *   Accumulator init();
+ *   bool fold(Accumulator &accumulator, ResultType &&result);
+ *   Result finish(Accumulator &&accumulator);
+ *
+ * fold returns false to stop the call, in which case the remaining services
+ * are not called. Streaming combiners are accepted wherever a vector combiner
+ * (a function taking std::vector<ResultType>) is accepted. */
+
+namespace detail {
+template <typename...>
+struct make_void {
+  typedef void type;
+};
+
+template <class Combiner, typename = void>
+struct is_streaming_combiner : std::false_type {};
+
+template <class Combiner>
+struct is_streaming_combiner<
+    Combiner,
+    typename make_void<decltype(std::declval<Combiner &>().init())>::type>
+    : std::true_type {};
+}
+
+/// Adapts a vector combiner to the streaming combiner interface. Results are
+/// collected into a vector, which is passed to the combiner at the end.
+template <typename ResultType, class Combiner>
+class VectorCombiner {
+ public:
+  explicit VectorCombiner(Combiner combiner)
+      : combiner_(std::forward<Combiner>(combiner)) {}
+
+  std::vector<ResultType> init() const { return {}; }
+
+  bool fold(std::vector<ResultType> &results, ResultType &&result) const {
+    results.emplace_back(std::move(result));
+    return true;
+  }
+
+  decltype(auto) finish(std::vector<ResultType> &&results) {
+    return combiner_(std::move(results));
+  }
+
+ private:
+  Combiner combiner_;
+};
+
+template <typename ResultType, class Combiner>
+VectorCombiner<ResultType, Combiner> make_vector_combiner(
+    Combiner &&combiner) {
+  return VectorCombiner<ResultType, Combiner>(
+      std::forward<Combiner>(combiner));
+}
+
+/// Returns the first result matching the predicate, or none if no result
+/// matches. Services following the matching one are not called.
+template <typename ResultType, class Predicate>
+class FirstOfCombiner {
+ public:
+  explicit FirstOfCombiner(Predicate predicate)
+      : predicate_(std::move(predicate)) {}
+
+  boost::optional<ResultType> init() const { return boost::none; }
+
+  bool fold(boost::optional<ResultType> &first, ResultType &&result) {
+    if (!predicate_(static_cast<ResultType const &>(result))) {
+      return true;
+    }
+    first = std::move(result);
+    return false;
+  }
+
+  boost::optional<ResultType> finish(boost::optional<ResultType> &&first) {
+    return std::move(first);
+  }
+
+ private:
+  Predicate predicate_;
+};
+
+template <typename ResultType, class Predicate>
+FirstOfCombiner<ResultType, std::decay_t<Predicate>> make_first_of(
+    Predicate &&predicate) {
+  return FirstOfCombiner<ResultType, std::decay_t<Predicate>>(
+      std::forward<Predicate>(predicate));
+}
+
+/// Folds the results into an accumulator, accumulator =
+/// fold(std::move(accumulator), std::move(result)).
+template <typename ResultType, typename Accumulator, class Fold>
+class FoldCombiner {
+ public:
+  FoldCombiner(Accumulator initial, Fold fold)
+      : initial_(std::move(initial)), fold_(std::move(fold)) {}
+
+  Accumulator init() const { return initial_; }
+
+  bool fold(Accumulator &accumulator, ResultType &&result) {
+    accumulator = fold_(std::move(accumulator), std::move(result));
+    return true;
+  }
+
+  Accumulator finish(Accumulator &&accumulator) {
+    return std::move(accumulator);
+  }
+
+ private:
+  Accumulator initial_;
+  Fold fold_;
+};
+
+template <typename ResultType, typename Accumulator, class Fold>
+FoldCombiner<ResultType, Accumulator, std::decay_t<Fold>> make_fold(
+    Accumulator initial, Fold &&fold) {
+  return FoldCombiner<ResultType, Accumulator, std::decay_t<Fold>>(
+      std::move(initial), std::forward<Fold>(fold));
+}
+
+#endif
@@ -0,0 +1,174 @@
+#ifndef SYMBOL_TABLE_HPP
+#define SYMBOL_TABLE_HPP
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
+#include <boost/optional.hpp>
+#include <boost/utility/string_view.hpp>
+
+/** An interned name. Symbol is a compact id of a name assigned by the
+ * SymbolTable. Ids of released names are reused; version distinguishes the
+ * names which had the same id. */
+struct Symbol {
+  std::uint32_t id;
+  std::uint32_t version;
+
+  bool operator==(Symbol other) const noexcept {
+    return id == other.id && version == other.version;
+  }
+  bool operator!=(Symbol other) const noexcept { return !(*this == other); }
+};
+
+/** Reference to a service or group name, given either as a string or as a
+ * symbol. NameRef does not own the string. */
+class NameRef {
+ public:
+  NameRef(boost::string_view name) : name_(name) {}
+  NameRef(std::string const &name) : name_(name) {}
+  NameRef(char const *name) : name_(name) {}
+#if __cplusplus >= 201703L
+  NameRef(std::string_view name) : name_(name.data(), name.size()) {}
+#endif
+  NameRef(Symbol symbol) : symbol_(symbol) {}
+
+  bool is_symbol() const noexcept { return static_cast<bool>(symbol_); }
+  // Valid only if the reference is not a symbol
+  boost::string_view name() const noexcept { return name_; }
+  // Valid only if the reference is a symbol
+  Symbol symbol() const noexcept { return *symbol_; }
+
+ private:
+  boost::string_view name_;
+  boost::optional<Symbol> symbol_;
+};
+
+/** Table of interned names. Each name is stored once and gets a symbol, which
+ * stays valid until the name is released. Lookup by any string type does not
+ * allocate. */
+class SymbolTable {
+ public:
+  SymbolTable() = default;
+  SymbolTable(SymbolTable const &other)
+      : names_(other.names_),
+        versions_(other.versions_),
+        released_(other.released_) {
+    reindex();
+  }
+  SymbolTable(SymbolTable &&) = default;
+
+  SymbolTable &operator=(SymbolTable other) {
+    std::swap(names_, other.names_);
+    std::swap(versions_, other.versions_);
+    std::swap(released_, other.released_);
+    std::swap(ids_, other.ids_);
+    return *this;
+  }
+
+  // Return symbol of the name. Name is added to the table if necessary.
+  Symbol intern(boost::string_view name) {
+    auto it = ids_.find(name);
+    if (it != ids_.end()) {
+      return it->second;
+    }
+    Symbol symbol{0, 0};
+    if (released_.empty()) {
+      names_.emplace_back(name.data(), name.size());
+      versions_.emplace_back(0);
+      symbol.id = static_cast<std::uint32_t>(names_.size() - 1);
+    } else {
+      symbol.id = released_.back();
+      released_.pop_back();
+      names_[symbol.id].assign(name.data(), name.size());
+      symbol.version = versions_[symbol.id];
+    }
+    ids_.emplace(names_[symbol.id], symbol);
+    return symbol;
+  }
+
+  // Release the name. Its id is reused by one of the following names, with a
+  // new version, so that the symbol never matches the new name.
+  void release(Symbol symbol) {
+    if (!contains(symbol)) {
+      return;
+    }
+    ids_.erase(names_[symbol.id]);
+    std::string().swap(names_[symbol.id]);
+    ++versions_[symbol.id];
+    released_.emplace_back(symbol.id);
+  }
+
+  // Whether the symbol refers to a name in the table, i.e. it was not
+  // released
+  bool contains(Symbol symbol) const noexcept {
+    return symbol.id < versions_.size() &&
+           versions_[symbol.id] == symbol.version;
+  }
+
+  // Return symbol of the name or none, if the name is not in the table
+  boost::optional<Symbol> find(boost::string_view name) const noexcept {
+    auto it = ids_.find(name);
+    if (it == ids_.end()) {
+      return boost::none;
+    }
+    return it->second;
+  }
+
+  // Name of the symbol. Empty if the symbol was released.
+  std::string const &name(Symbol symbol) const {
+    static const std::string released;
+    return contains(symbol) ? names_[symbol.id] : released;
+  }
+
+  // Number of interned names
+  std::size_t size() const noexcept { return ids_.size(); }
+
+  // Upper bound of the symbol ids
+  std::size_t capacity() const noexcept { return names_.size(); }
+
+ private:
+  struct hash {
+    std::size_t operator()(boost::string_view name) const noexcept {
+#if __cplusplus >= 201703L
+      return std::hash<std::string_view>()({name.data(), name.size()});
+#else
+      // FNV-1a
+      std::uint64_t hash = 14695981039346656037ull;
+      for (auto c : name) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+      }
+      return static_cast<std::size_t>(hash);
+#endif
+    }
+  };
+
+  void reindex() {
+    std::vector<bool> released(names_.size(), false);
+    for (auto id : released_) {
+      released[id] = true;
+    }
+    for (std::uint32_t id = 0; id < names_.size(); ++id) {
+      if (!released[id]) {
+        ids_.emplace(names_[id], Symbol{id, versions_[id]});
+      }
+    }
+  }
+
+  // Deque never moves the stored names, so that the keys can refer to them
+  std::deque<std::string> names_;
+  // Current version of each id
+  std::vector<std::uint32_t> versions_;
+  // Ids of the released names, which are reused first
+  std::vector<std::uint32_t> released_;
+  std::unordered_map<boost::string_view, Symbol, hash> ids_;
+};
+
+#endif
@@ -0,0 +1,334 @@
+#ifndef TASK_QUEUE_HPP
+#define TASK_QUEUE_HPP
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <threadpool/ThreadedQueue.hpp>
+
+#include "Tracing.hpp"
+#include "detail/noncopyable.hpp"
+
+/** What a full task queue does with a new task. */
+enum class Backpressure {
+  // Producer waits until the worker makes room
+  Block,
+  // New task is dropped
+  DropNewest,
+  // Oldest queued task is dropped to make room
+  DropOldest,
+  // New task replaces the queued task with the same key, which is counted as
+  // coalesced. If there is none, the oldest queued task is dropped to make
+  // room.
+  Coalesce
+};
+
+/** Capacity of a task queue and what to do when it is full. */
+template <typename T>
+struct TaskQueueOptions {
+  // Maximum number of queued tasks, 0 for unbounded
+  std::size_t capacity = 0;
+  Backpressure backpressure = Backpressure::Block;
+  // Key of the task for Backpressure::Coalesce. Tasks with equal keys
+  // replace each other.
+  std::function<std::size_t(T const &)> key;
+};
+
+/** When a task was queued and the trace it belongs to. */
+struct TaskStamp {
+  std::chrono::steady_clock::time_point queued;
+  TraceContext trace;
+};
+
+/** Task queue of the workers. Same interface as threaded_queue, extended with
+ * a bounded capacity, pulling of the tasks in batches and closing. Tasks are
+ * stamped with the time they were queued and the trace of the queueing
+ * thread. Pulling optionally returns the stamps. */
+template <typename T>
+class TaskQueue : noncopyable {
+ public:
+  using options_type = TaskQueueOptions<T>;
+  using clock = std::chrono::steady_clock;
+
+  bool push_back(T const &value) { return push_back(T(value)); }
+
+  // Queue the task. Returns false if the task was dropped. A task dropped to
+  // make room is counted as a dropped one, a task replaced by a newer one as
+  // a coalesced one. Coalescing looks the key up in an index of the queued
+  // tasks.
+  bool push_back(T &&value) {
+    {
+      std::unique_lock<std::mutex> lk(mtx_);
+      if (closed_) {
+        return false;
+      }
+      auto const &options = options_;
+      std::size_t key = 0;
+      if (coalescing_()) {
+        key = options.key(value);
+        auto same = index_.find(key);
+        if (same != index_.end()) {
+          *same->second = {std::move(value), stamp_(), key};
+          ++coalesced_;
+          return true;
+        }
+      }
+      if (full_()) {
+        switch (options.backpressure) {
+          case Backpressure::Block:
+            not_full_.wait(lk, [this]() { return closed_ || !full_(); });
+            if (closed_) {
+              return false;
+            }
+            break;
+          case Backpressure::DropNewest:
+            ++dropped_;
+            return false;
+          case Backpressure::DropOldest:
+          case Backpressure::Coalesce:
+            unindex_front_();
+            queue_.pop_front();
+            ++dropped_;
+            break;
+        }
+      }
+      queue_.push_back({std::move(value), stamp_(), key});
+      if (coalescing_()) {
+        index_[key] = &queue_.back();
+      }
+    }
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // Wait for a task and remove it from the queue. Returns a default
+  // constructed task if the queue is closed.
+  T pull_front() {
+    T value = T();
+    pull_front(value);
+    return value;
+  }
+
+  // Wait for a task and move it to value. Returns false if the queue is
+  // closed.
+  bool pull_front(T &value, TaskStamp *stamp = nullptr) {
+    {
+      std::unique_lock<std::mutex> lk(mtx_);
+      not_empty_.wait(lk, [this]() { return closed_ || !queue_.empty(); });
+      if (closed_) {
+        return false;
+      }
+      pop_front_(value, stamp);
+    }
+    not_full_.notify_one();
+    return true;
+  }
+
+  queue_op_status try_pull_front(T &value,
+                                 TaskStamp *stamp = nullptr) {
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      if (queue_.empty()) {
+        return queue_op_status::empty;
+      }
+      pop_front_(value, stamp);
+    }
+    not_full_.notify_one();
+    return queue_op_status::success;
+  }
+
+  // Wait until a task is queued. Returns false if the queue is closed.
+  bool wait() {
+    std::unique_lock<std::mutex> lk(mtx_);
+    not_empty_.wait(lk, [this]() { return closed_ || !queue_.empty(); });
+    return !closed_;
+  }
+
+  // Wait for a task and move up to max_size tasks to the batch. If fewer
+  // tasks are queued, waits for max_delay after the first task for more
+  // tasks to arrive. Returns false if the queue is closed.
+  bool pull_front(std::vector<T> &batch, std::size_t max_size,
+                  std::chrono::microseconds max_delay,
+                  std::vector<TaskStamp> *stamps = nullptr) {
+    {
+      std::unique_lock<std::mutex> lk(mtx_);
+      not_empty_.wait(lk, [this]() { return closed_ || !queue_.empty(); });
+      if (queue_.size() < max_size && max_delay.count() > 0) {
+        not_empty_.wait_for(lk, max_delay, [this, max_size]() {
+          return closed_ || queue_.size() >= max_size;
+        });
+      }
+      if (closed_) {
+        return false;
+      }
+      pop_front_(batch, max_size, stamps);
+    }
+    not_full_.notify_all();
+    return true;
+  }
+
+  // Move up to max_size queued tasks to the batch without waiting. Returns
+  // false if there were none.
+  bool try_pull_front(std::vector<T> &batch, std::size_t max_size,
+                      std::vector<TaskStamp> *stamps = nullptr) {
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      if (queue_.empty()) {
+        return false;
+      }
+      pop_front_(batch, max_size, stamps);
+    }
+    not_full_.notify_all();
+    return true;
+  }
+
+  // Wake up all waiting producers and consumers. Queued tasks are discarded
+  // and no more tasks are accepted.
+  void close() {
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      closed_ = true;
+      queue_.clear();
+      index_.clear();
+    }
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  }
+
+  // Close the queue and move the queued tasks to the batch instead of
+  // discarding them
+  void close(std::vector<T> &batch, std::vector<TaskStamp> *stamps = nullptr) {
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      closed_ = true;
+      pop_front_(batch, queue_.size(), stamps);
+      index_.clear();
+    }
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  }
+
+  void set_options(options_type options) {
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      options_ = std::move(options);
+      reindex_();
+    }
+    not_full_.notify_all();
+  }
+
+  options_type options() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return options_;
+  }
+
+  std::size_t size() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return queue_.size();
+  }
+
+  bool empty() const { return size() == 0; }
+
+  // Number of dropped tasks
+  std::size_t dropped() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return dropped_;
+  }
+
+  // Number of tasks replaced by a newer task with the same key
+  std::size_t coalesced() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return coalesced_;
+  }
+
+ private:
+  struct entry {
+    T value;
+    TaskStamp stamp;
+    // Key of the task, if the queue coalesces
+    std::size_t key;
+  };
+
+  static TaskStamp stamp_() { return {clock::now(), tracing::current()}; }
+
+  // Must be called with the mutex locked
+  bool coalescing_() const {
+    return options_.backpressure == Backpressure::Coalesce &&
+           static_cast<bool>(options_.key);
+  }
+
+  // Rebuild the index for the new options. Newest of the tasks with equal
+  // keys is replaced first. Must be called with the mutex locked.
+  void reindex_() {
+    index_.clear();
+    if (!coalescing_()) {
+      return;
+    }
+    for (auto &e : queue_) {
+      e.key = options_.key(e.value);
+      index_[e.key] = &e;
+    }
+  }
+
+  // Remove the front task from the index. Must be called with the mutex
+  // locked.
+  void unindex_front_() {
+    if (index_.empty()) {
+      return;
+    }
+    auto it = index_.find(queue_.front().key);
+    if (it != index_.end() && it->second == &queue_.front()) {
+      index_.erase(it);
+    }
+  }
+
+  // Must be called with the mutex locked
+  void pop_front_(T &value, TaskStamp *stamp) {
+    unindex_front_();
+    value = std::move(queue_.front().value);
+    if (stamp) {
+      *stamp = queue_.front().stamp;
+    }
+    queue_.pop_front();
+  }
+
+  // Must be called with the mutex locked
+  void pop_front_(std::vector<T> &batch, std::size_t max_size,
+                  std::vector<TaskStamp> *stamps) {
+    while (!queue_.empty() && batch.size() < max_size) {
+      unindex_front_();
+      if (stamps) {
+        stamps->push_back(queue_.front().stamp);
+      }
+      batch.emplace_back(std::move(queue_.front().value));
+      queue_.pop_front();
+    }
+  }
+
+  bool full_() const {
+    return options_.capacity != 0 && queue_.size() >= options_.capacity;
+  }
+
+  mutable std::mutex mtx_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  // Elements of a deque stay in place when the others are pushed or popped at
+  // the ends, so that the index can point to them
+  std::deque<entry> queue_;
+  // Queued task of each key, if the queue coalesces
+  std::unordered_map<std::size_t, entry *> index_;
+  options_type options_;
+  std::size_t dropped_ = 0;
+  std::size_t coalesced_ = 0;
+  bool closed_ = false;
+};
+
+#endif
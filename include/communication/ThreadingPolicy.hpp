@@ -0,0 +1,32 @@
+#ifndef THREADING_POLICY_HPP
+#define THREADING_POLICY_HPP
+
+#pragma once
+
+#include "ContextExecutor.hpp"
+#include "SharedContextExecutor.hpp"
+#include "detail/runner.hpp"
+
+/** Threading policies of the workers. */
+
+// Worker runs on its own threads. WorkerMultiThreaded executes the tasks on
+// its own executor threads.
+struct DedicatedThreads {
+  using runner_type = detail::thread_runner;
+  template <typename ContextType>
+  using context_executor_type = ContextExecutor<ContextType>;
+};
+
+// Worker runs as tasks on Executor::shared(), which has a thread per core and
+// balances the load by work stealing. The worker is scheduled only when it
+// has work and never runs on two threads at the same time, so that it
+// processes its tasks in order. WorkerMultiThreaded executes the tasks on the
+// same executor as well. Blocking backpressure of a worker stalls a thread of
+// the shared executor.
+struct SharedScheduler {
+  using runner_type = detail::scheduled_runner;
+  template <typename ContextType>
+  using context_executor_type = SharedContextExecutor<ContextType>;
+};
+
+#endif
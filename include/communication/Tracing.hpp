@@ -0,0 +1,319 @@
+#ifndef TRACING_HPP
+#define TRACING_HPP
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Affinity.hpp"
+
+/** Trace of a request through the pipeline. Zero id means the request is not
+ * traced. Workers take the context of a task from the thread which queued
+ * it, so that it follows the results through the connected workers without
+ * being part of the payload.
+ *
+ * The current context is thread-local. Workers and ContextExecutor carry it
+ * with the queued task to their threads, other hops lose it: messages posted
+ * to a Mailbox, functions submitted to an Executor or posted to an EventLoop,
+ * and with them the offloaded calls of a coroutine, run untraced unless the
+ * caller captures tracing::current() and restores it there with
+ * tracing::scoped_context. */
+struct TraceContext {
+  std::uint64_t id = 0;
+
+  explicit operator bool() const noexcept { return id != 0; }
+};
+
+/** Span of a traced request. Names are interned and live as long as the
+ * program. */
+struct TraceSpan {
+  std::uint64_t trace_id;
+  // Phase, e.g. "execute"
+  char const *name;
+  // Worker which recorded the span
+  char const *worker;
+  std::chrono::steady_clock::time_point begin;
+  std::chrono::steady_clock::time_point end;
+  // Thread id of the operating system
+  long thread_id;
+};
+
+/** Tracing of the requests. Workers record the spans of the traced requests
+ * into per-thread buffers without a lock: enqueue (queueing of the task),
+ * dequeue (time in the queue), preprocess, execute, postprocess and emit
+ * (signalling of the result). If a request is not traced, a worker checks its
+ * trace id only. */
+namespace tracing {
+namespace detail {
+// Spans a thread may record before they are collected. Further spans are
+// dropped.
+constexpr std::size_t buffer_capacity = 1 << 14;
+
+// Ring of spans with a single producer, the thread, and a single consumer,
+// the collector
+struct thread_buffer {
+  explicit thread_buffer(long thread_id)
+      : thread_id(thread_id), spans(buffer_capacity) {}
+
+  long thread_id;
+  std::vector<TraceSpan> spans;
+  std::atomic<std::size_t> head{0};
+  std::atomic<std::size_t> tail{0};
+  std::atomic<std::size_t> dropped{0};
+};
+
+struct registry {
+  std::atomic<bool> enabled{false};
+  std::atomic<std::uint64_t> next_id{1};
+  // Guards the buffers, the names and the collection
+  std::mutex mtx;
+  std::vector<std::shared_ptr<thread_buffer>> buffers;
+  std::set<std::string> names;
+};
+
+inline registry &get_registry() {
+  static registry reg;
+  return reg;
+}
+
+inline TraceContext &current() noexcept {
+  thread_local TraceContext context;
+  return context;
+}
+
+inline thread_buffer &local_buffer() {
+  thread_local std::shared_ptr<thread_buffer> buffer = []() {
+    auto buffer =
+        std::make_shared<thread_buffer>(affinity::current_thread_id());
+    auto &reg = get_registry();
+    std::lock_guard<std::mutex> lk(reg.mtx);
+    reg.buffers.push_back(buffer);
+    return buffer;
+  }();
+  return *buffer;
+}
+
+inline void write_string(std::ostream &out, char const *value) {
+  out << '"';
+  for (; *value; ++value) {
+    switch (*value) {
+      case '"':
+        out << "\\\"";
+        break;
+      case '\\':
+        out << "\\\\";
+        break;
+      default:
+        if (static_cast<unsigned char>(*value) < 0x20) {
+          out << ' ';
+        } else {
+          out << *value;
+        }
+    }
+  }
+  out << '"';
+}
+}
+
+// New traces are started only while tracing is enabled. Requests which are
+// traced already are traced to the end.
+inline void enable(bool enabled = true) {
+  detail::get_registry().enabled.store(enabled, std::memory_order_relaxed);
+}
+
+inline bool enabled() {
+  return detail::get_registry().enabled.load(std::memory_order_relaxed);
+}
+
+// Context of a new trace, or of no trace if tracing is disabled
+inline TraceContext start_trace() {
+  auto &reg = detail::get_registry();
+  if (!reg.enabled.load(std::memory_order_relaxed)) {
+    return {};
+  }
+  return {reg.next_id.fetch_add(1, std::memory_order_relaxed)};
+}
+
+// Trace of the work done by the calling thread
+inline TraceContext current() noexcept { return detail::current(); }
+
+// Name which lives as long as the program
+inline char const *intern(std::string const &name) {
+  auto &reg = detail::get_registry();
+  std::lock_guard<std::mutex> lk(reg.mtx);
+  return reg.names.insert(name).first->c_str();
+}
+
+// Name which is interned when the first span is recorded with it, so that
+// names which are never traced do not stay in memory
+class lazy_name {
+ public:
+  explicit lazy_name(std::string name) : name_(std::move(name)) {}
+
+  char const *get() const {
+    auto interned = interned_.load(std::memory_order_acquire);
+    if (!interned) {
+      interned = intern(name_);
+      interned_.store(interned, std::memory_order_release);
+    }
+    return interned;
+  }
+
+ private:
+  std::string name_;
+  mutable std::atomic<char const *> interned_{nullptr};
+};
+
+// Record the span into the buffer of the calling thread, if the request is
+// traced
+inline void record(TraceContext trace, char const *name, char const *worker,
+                   std::chrono::steady_clock::time_point begin,
+                   std::chrono::steady_clock::time_point end) {
+  if (!trace) {
+    return;
+  }
+  auto &buffer = detail::local_buffer();
+  auto head = buffer.head.load(std::memory_order_relaxed);
+  if (head - buffer.tail.load(std::memory_order_acquire) >=
+      detail::buffer_capacity) {
+    buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  buffer.spans[head % detail::buffer_capacity] = {
+      trace.id, name, worker, begin, end, buffer.thread_id};
+  buffer.head.store(head + 1, std::memory_order_release);
+}
+
+inline void record(TraceContext trace, char const *name,
+                   lazy_name const &worker,
+                   std::chrono::steady_clock::time_point begin,
+                   std::chrono::steady_clock::time_point end) {
+  if (trace) {
+    record(trace, name, worker.get(), begin, end);
+  }
+}
+
+// Sets the trace of the calling thread for the lifetime of the scope
+class scoped_context {
+ public:
+  explicit scoped_context(TraceContext trace) noexcept
+      : previous_(detail::current()) {
+    detail::current() = trace;
+  }
+  ~scoped_context() { detail::current() = previous_; }
+  scoped_context(scoped_context const &) = delete;
+  scoped_context &operator=(scoped_context const &) = delete;
+
+ private:
+  TraceContext previous_;
+};
+
+// Records the span from its construction to its destruction, if the request
+// is traced
+class span {
+ public:
+  span(TraceContext trace, char const *name, char const *worker)
+      : trace_(trace), name_(name), worker_(worker) {
+    if (trace_) {
+      begin_ = std::chrono::steady_clock::now();
+    }
+  }
+  span(TraceContext trace, char const *name, lazy_name const &worker)
+      : span(trace, name, trace ? worker.get() : nullptr) {}
+  ~span() {
+    if (trace_) {
+      record(trace_, name_, worker_, begin_, std::chrono::steady_clock::now());
+    }
+  }
+  span(span const &) = delete;
+  span &operator=(span const &) = delete;
+
+ private:
+  TraceContext trace_;
+  char const *name_;
+  char const *worker_;
+  std::chrono::steady_clock::time_point begin_;
+};
+
+// Remove the recorded spans from the buffers of all threads
+inline std::vector<TraceSpan> collect() {
+  std::vector<TraceSpan> spans;
+  auto &reg = detail::get_registry();
+  std::lock_guard<std::mutex> lk(reg.mtx);
+  for (auto it = reg.buffers.begin(); it != reg.buffers.end();) {
+    auto &buffer = **it;
+    auto tail = buffer.tail.load(std::memory_order_relaxed);
+    auto head = buffer.head.load(std::memory_order_acquire);
+    for (auto i = tail; i != head; ++i) {
+      spans.push_back(buffer.spans[i % detail::buffer_capacity]);
+    }
+    buffer.tail.store(head, std::memory_order_release);
+    // Buffer of a finished thread is removed once it is empty
+    if (it->use_count() == 1) {
+      it = reg.buffers.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  return spans;
+}
+
+// Number of spans dropped by the full buffers of the running threads
+inline std::size_t dropped() {
+  auto &reg = detail::get_registry();
+  std::lock_guard<std::mutex> lk(reg.mtx);
+  std::size_t dropped = 0;
+  for (auto const &buffer : reg.buffers) {
+    dropped += buffer->dropped.load(std::memory_order_relaxed);
+  }
+  return dropped;
+}
+
+// Write the spans in the JSON trace format of Chrome, which Perfetto and
+// chrome://tracing open. Spans are complete events on the threads which
+// recorded them, with the trace id and the worker as arguments.
+inline void write_chrome_trace(std::ostream &out,
+                               std::vector<TraceSpan> const &spans) {
+  using microseconds = std::chrono::duration<double, std::micro>;
+  auto flags = out.flags();
+  auto precision = out.precision();
+  out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+  for (std::size_t i = 0; i < spans.size(); ++i) {
+    auto const &span = spans[i];
+    out << (i == 0 ? "" : ",") << "\n{\"name\":";
+    detail::write_string(out, span.name);
+    out << ",\"cat\":";
+    detail::write_string(out, span.worker);
+    out << ",\"ph\":\"X\",\"ts\":"
+        << microseconds(span.begin.time_since_epoch()).count()
+        << ",\"dur\":" << microseconds(span.end - span.begin).count()
+        << ",\"pid\":1,\"tid\":" << span.thread_id
+        << ",\"args\":{\"trace_id\":" << span.trace_id << ",\"worker\":";
+    detail::write_string(out, span.worker);
+    out << "}}";
+  }
+  out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+  out.flags(flags);
+  out.precision(precision);
+}
+
+// Collect the spans and return them as a Chrome trace
+inline std::string chrome_trace() {
+  std::ostringstream out;
+  write_chrome_trace(out, collect());
+  return out.str();
+}
+}
+
+#endif
@@ -4,12 +4,19 @@
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
 
 #include <boost/signals2.hpp>
 
 #include <cxml/cxml.hpp>
 
+#include "detail/snapshot.hpp"
 #include "detail/type_constraints.hpp"
+#include "Affinity.hpp"
+#include "LatencyHistogram.hpp"
+#include "Tracing.hpp"
 #include "threadpool/PerformanceStatistics.hpp"
 #include "ServiceBroker.hpp"
 #include "Log.hpp"
@@ -20,8 +27,8 @@ template <class BrokerType, class ConfigurationType>
 class WorkerBaseT {
  public:
   template <typename T>
-  using signal_t = boost::signals2::signal<T>;
-  using slot_type = boost::signals2::connection;
+  using signal_t = ::signal_t<T>;
+  using slot_type = Connection;
   using broker_type = BrokerType;
   using configuration_type = ConfigurationType;
   using self_type = WorkerBaseT<BrokerType, ConfigurationType>;
@@ -34,9 +41,11 @@ class WorkerBaseT {
               std::shared_ptr<BrokerType> broker)
       : worker_name_(worker_name),
         broker_(broker),
-        configuration_changed_(false) {
+        configuration_(
+            std::make_shared<detail::snapshot<configuration_type>>()) {
     // Register all services with the broker
-    add_service(log, error, on_set_configuration, on_get_configuration);
+    add_service(log, error, on_set_configuration, on_get_configuration,
+                on_metrics);
 
     // Register callbacks
     register_callback(on_set_configuration.name,
@@ -45,6 +54,8 @@ class WorkerBaseT {
                       });
     register_callback(on_get_configuration.name,
                       [this]() { return get_configuration(); });
+    register_callback(on_metrics.name,
+                      [this](bool reset) { return latency_metrics(reset); });
   }
 
   // Disconnect all connections and remove all services
@@ -52,31 +63,24 @@ class WorkerBaseT {
     for (auto &connection : slots_) {
       connection.disconnect();
     }
-    remove_service(log, error, on_set_configuration, on_get_configuration);
+    remove_service(log, error, on_set_configuration, on_get_configuration,
+                   on_metrics);
   }
 
-  // Update configuration storage and set changed flag to true. Implementation
-  // of the derived class should take care to safely update the actual
-  // configuration.
+  // Publish the configuration as a new snapshot. The data path reads it with
+  // configuration() without a lock. set_configuration_ is called at once if
+  // the worker is idle, otherwise the worker calls it before its next task;
+  // it never runs concurrently with the data path.
   virtual void set_configuration(configuration_type configuration) {
-    // Set temporary configuration storage
-    std::lock_guard<std::mutex> storage_lock(configuration_storage_mtx_);
-    configuration_storage_ = configuration;
-
-    // Check if we can update configuration immediately
-    std::unique_lock<std::mutex> configuration_lock(configuration_mtx_,
-                                                    std::try_to_lock_t());
-    if (configuration_lock.owns_lock()) {
-      // Immediately set configuration
-      set_configuration_(configuration);
-    } else {
-      // Defer configuration change
-      configuration_changed_ = true;
+    configuration_->store(
+        std::make_shared<configuration_type const>(std::move(configuration)));
+    std::unique_lock<std::mutex> lk(configuration_mtx_, std::try_to_lock);
+    if (lk.owns_lock()) {
+      update_configuration();
     }
   };
 
-  // Get configuration. Configuration can probably be returned without much
-  // synchronization.
+  // Get configuration
   virtual configuration_type get_configuration() const {
     return get_configuration_();
   };
@@ -85,6 +89,17 @@ class WorkerBaseT {
     return PerformanceStatistics();
   }
 
+  // Latency histograms of the tasks. If reset is set, a new interval starts.
+  LatencyMetrics latency_metrics(bool reset = false) {
+    return latency_.snapshot(reset);
+  }
+
+  // Pin the threads of the worker to the CPUs or the NUMA node
+  virtual void set_placement(Placement /*placement*/) {}
+
+  // Where the threads of the worker run
+  virtual std::vector<ThreadPlacement> topology() const { return {}; }
+
   // Return workers name
   std::string name() const { return worker_name_; }
 
@@ -105,13 +120,30 @@ class WorkerBaseT {
   }
   void remove_service() {}
 
-  // Re-implement this function to get the desired functionality
+  // Current configuration. Lock-free, the snapshot stays valid while it is
+  // held.
+  std::shared_ptr<configuration_type const> configuration() const {
+    return configuration_->load();
+  }
+
+  // Call set_configuration_ with the latest snapshot, if it changed since it
+  // was applied. Costs a single load if it is unchanged. Must be called with
+  // configuration_mtx_ locked, which the data path holds while it runs.
+  void update_configuration() {
+    auto version = configuration_->version();
+    if (version != applied_version_) {
+      applied_version_ = version;
+      set_configuration_(*configuration_->load());
+    }
+  }
+
+  // Re-implement this function to get the desired functionality. Called
+  // between the tasks, see set_configuration.
   virtual void set_configuration_(configuration_type const &configuration) {}
 
   // Re-implement this function to get the desired functionality
   virtual configuration_type get_configuration_() const {
-    std::lock_guard<std::mutex> lck(configuration_storage_mtx_);
-    return configuration_storage_;
+    return *configuration_->load();
   }
 
   // Connect callback to the service via service broker
@@ -140,33 +172,41 @@ class WorkerBaseT {
                       std::forward<Args>(input_services)...);
   }
 
-  // Should be called when it is safe to set deferred configuration.
-  void update_configuration() {
-    std::unique_lock<std::mutex> storage_lock(configuration_storage_mtx_,
-                                              std::defer_lock);
-    std::unique_lock<std::mutex> configuration_lock(configuration_mtx_,
-                                                    std::defer_lock);
-    std::lock(storage_lock, configuration_lock);
-    set_configuration_(configuration_storage_);
-    configuration_changed_ = false;
+  // Log a warning if tasks were dropped since the last report. Reports at most
+  // once per second.
+  void report_dropped(std::size_t dropped) {
+    auto now = std::chrono::steady_clock::now();
+    if (dropped == reported_dropped_ ||
+        now - reported_time_ < std::chrono::seconds(1)) {
+      return;
+    }
+    log({Log::Severity::Warning,
+         std::to_string(dropped - reported_dropped_) + " tasks dropped by " +
+             worker_name_});
+    reported_dropped_ = dropped;
+    reported_time_ = now;
   }
 
-  // Should be locked while configuration should be unchanged
-  mutable std::mutex configuration_mtx_;
-
-  // Configuration storage, for deferring configuration change if it cannot be
-  // safely changed. If configuration change was deferred,
-  // configuration_changed_ flag is set.
-  configuration_type configuration_storage_;
-  mutable std::mutex configuration_storage_mtx_;
-  std::atomic<bool> configuration_changed_;
-
   // Service broker
   std::shared_ptr<BrokerType> broker_;
   // All connections
   std::vector<slot_type> slots_;
+  // Configuration snapshots, shared with the contexts of the worker
+  std::shared_ptr<detail::snapshot<configuration_type>> configuration_;
+  // Version of the snapshot applied by set_configuration_
+  std::uint64_t applied_version_ = 0;
+  // Locked by the data path while it runs, so that set_configuration_ is
+  // deferred until the worker is idle
+  mutable std::mutex configuration_mtx_;
   // Worker name
   std::string worker_name_ = "worker";
+  // Worker name of the trace spans, interned by the first traced request
+  tracing::lazy_name trace_name_{worker_name_};
+  // Latencies of the tasks, recorded by the derived workers
+  LatencyHistograms latency_;
+  // Number of dropped tasks at the last report and time of the report
+  std::size_t reported_dropped_ = 0;
+  std::chrono::steady_clock::time_point reported_time_;
   // Logging signal
   Service<void, Log> log = {"log." + worker_name_};
   // Error signal
@@ -177,6 +217,8 @@ class WorkerBaseT {
   // Get configuration slot
   Service<configuration_type> on_get_configuration = {"configuration.get." +
                                                       worker_name_};
+  // Latency metrics slot. Argument starts a new interval.
+  Service<LatencyMetrics, bool> on_metrics = {"metrics." + worker_name_};
 };
 
 #endif
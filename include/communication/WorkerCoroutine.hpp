@@ -0,0 +1,456 @@
+#ifndef WORKER_COROUTINE_HPP
+#define WORKER_COROUTINE_HPP
+
+#pragma once
+
+#if !defined(__cpp_impl_coroutine)
+#error "WorkerCoroutine.hpp requires C++20 coroutines"
+#endif
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <sys/epoll.h>
+
+#include "detail/type_constraints.hpp"
+#include "ContextExecutor.hpp"
+#include "EventLoop.hpp"
+#include "Executor.hpp"
+#include "ServiceBroker.hpp"
+#include "TaskQueue.hpp"
+#include "WorkerBase.hpp"
+
+/** Lazily started coroutine with a result. Awaiting the task starts it and
+ * resumes the awaiting coroutine with the result, or rethrows the exception
+ * of the task. */
+template <typename T>
+class Task {
+ public:
+  static_assert(!std::is_void<T>::value, "Task must have a result.");
+
+  struct promise_type {
+    std::optional<T> value;
+    std::exception_ptr error;
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    auto final_suspend() noexcept {
+      // Resumes the awaiting coroutine
+      struct final_awaiter {
+        bool await_ready() const noexcept { return false; }
+        std::coroutine_handle<> await_suspend(
+            std::coroutine_handle<promise_type> handle) noexcept {
+          return handle.promise().continuation;
+        }
+        void await_resume() const noexcept {}
+      };
+      return final_awaiter{};
+    }
+    template <typename U>
+    void return_value(U &&result) {
+      value.emplace(std::forward<U>(result));
+    }
+    void unhandled_exception() { error = std::current_exception(); }
+  };
+
+  Task(Task &&other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+  Task(Task const &) = delete;
+  Task &operator=(Task const &) = delete;
+  Task &operator=(Task &&) = delete;
+
+  ~Task() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  bool await_ready() const noexcept { return false; }
+
+  std::coroutine_handle<> await_suspend(
+      std::coroutine_handle<> continuation) noexcept {
+    handle_.promise().continuation = continuation;
+    return handle_;
+  }
+
+  T await_resume() {
+    if (handle_.promise().error) {
+      std::rethrow_exception(handle_.promise().error);
+    }
+    return std::move(*handle_.promise().value);
+  }
+
+ private:
+  explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail {
+// Coroutine which starts at once and destroys itself when it finishes
+struct detached_task {
+  struct promise_type {
+    detached_task get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+};
+
+// Resumes the coroutine on the loop once the descriptor is ready
+struct ready_awaiter {
+  EventLoop &loop;
+  int fd;
+  std::uint32_t events;
+
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> handle) {
+    loop.on_ready(fd, events, [handle]() { handle.resume(); });
+  }
+  void await_resume() const noexcept {}
+};
+
+// Resumes the coroutine on the loop after the delay
+struct delay_awaiter {
+  EventLoop &loop;
+  EventLoop::clock::duration delay;
+
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> handle) {
+    loop.after(delay, [handle]() { handle.resume(); });
+  }
+  void await_resume() const noexcept {}
+};
+
+// Runs the function on the executor and resumes the coroutine on the loop
+// with its result
+template <typename Function>
+struct offload_awaiter {
+  using result_type = std::invoke_result_t<Function &>;
+  using value_type = std::conditional_t<std::is_void<result_type>::value,
+                                        bool, result_type>;
+
+  EventLoop &loop;
+  Executor &executor;
+  Function function;
+  std::optional<value_type> value;
+  std::exception_ptr error;
+
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> handle) {
+    executor.submit([this, handle]() {
+      try {
+        if constexpr (std::is_void<result_type>::value) {
+          function();
+          value.emplace(true);
+        } else {
+          value.emplace(function());
+        }
+      } catch (...) {
+        error = std::current_exception();
+      }
+      loop.post([handle]() { handle.resume(); });
+    });
+  }
+  result_type await_resume() {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    if constexpr (!std::is_void<result_type>::value) {
+      return std::move(*value);
+    }
+  }
+};
+}
+
+/** Worker for I/O-bound stages. Run is a coroutine which suspends while it
+ * waits for a descriptor, a timer, a blocking function offloaded to the
+ * shared executor or a call of other services, so that a few threads keep
+ * many tasks in flight. Coroutines run and resume on the shared event loop
+ * and must not block it; CPU-bound work belongs to the other workers or is
+ * offloaded. Up to max_in_flight tasks run at a time. Results are signalled
+ * as the tasks complete, the sequenced results carry the order of arrival.
+ * Tasks in flight resume into run, so the most-derived worker calls stop() in
+ * its destructor. Destroying a worker with tasks in flight without stop() is
+ * an error, which is logged and asserted. The worker must not be destroyed on
+ * the loop thread. */
+template <typename ArgumentType, typename ResultType, typename BrokerType,
+          typename ConfigurationType>
+class WorkerCoroutineT : public WorkerBaseT<BrokerType, ConfigurationType> {
+ public:
+  using Base = WorkerBaseT<BrokerType, ConfigurationType>;
+  using argument_type = ArgumentType;
+  using result_type = ResultType;
+  using broker_type = BrokerType;
+  using configuration_type = ConfigurationType;
+  using task_type = Task<result_type>;
+
+  Service<void, result_type> result_signal = {this->worker_name_ + ".result"};
+  // Signal the results with the sequence numbers of their tasks
+  Service<void, Sequenced<result_type>> sequenced_result_signal = {
+      this->worker_name_ + ".sequenced_result"};
+
+ public:
+  WorkerCoroutineT(std::string const &worker_name,
+                   std::shared_ptr<BrokerType> broker)
+      : Base(worker_name, broker),
+        loop_(EventLoop::shared()),
+        executor_(Executor::shared()) {
+    this->add_service(result_signal, sequenced_result_signal);
+  }
+
+  WorkerCoroutineT(std::string const &worker_name,
+                   std::shared_ptr<BrokerType> broker,
+                   std::vector<std::string> const &inputs)
+      : WorkerCoroutineT(worker_name, broker) {
+    for (const auto &input : inputs) {
+      this->register_callback(input + ".result", [this](argument_type task) {
+        push_(std::move(task));
+      });
+    }
+  }
+
+  template <typename... InputServices>
+  WorkerCoroutineT(std::string const &worker_name,
+                   std::shared_ptr<BrokerType> broker,
+                   InputServices &&... inputs)
+      : WorkerCoroutineT(worker_name, broker) {
+    static_assert(detail::are_valid_services<InputServices...>::value,
+                  "Invalid input. Input should be of type Service.");
+    this->register_callback(
+        [this](argument_type task) { push_(std::move(task)); },
+        std::forward<InputServices>(inputs)...);
+  }
+
+  // Queued tasks are discarded. Tasks still in flight here would resume into
+  // the destroyed derived worker, see stop.
+  ~WorkerCoroutineT() {
+    this->remove_service(result_signal, sequenced_result_signal);
+    task_queue_.close();
+    auto in_flight = stopped_ ? 0 : in_flight_.load();
+    if (in_flight != 0) {
+      this->log({Log::Severity::Error,
+                 std::to_string(in_flight) + " tasks in flight in " +
+                     this->worker_name_ + ", destroyed without stop()"});
+    }
+    assert(in_flight == 0 && "worker destroyed without stop()");
+    stop();
+  }
+
+  // Publish the configuration. set_configuration_ is called on the loop,
+  // between the steps of the coroutines.
+  void set_configuration(configuration_type configuration) override {
+    this->configuration_->store(
+        std::make_shared<configuration_type const>(std::move(configuration)));
+    schedule_();
+  }
+
+  std::size_t pending() const noexcept { return task_queue_.size(); }
+
+  // Number of tasks which have started and not completed
+  std::size_t in_flight() const noexcept { return in_flight_; }
+
+  // Bound the number of tasks in flight, at least one
+  void set_max_in_flight(std::size_t max_in_flight) {
+    max_in_flight_ = std::max<std::size_t>(max_in_flight, 1u);
+    schedule_();
+  }
+
+  std::size_t max_in_flight() const noexcept { return max_in_flight_; }
+
+  // Bound the task queue. Tasks dropped by a full queue are counted and
+  // reported as warnings on the log service.
+  void set_queue_options(TaskQueueOptions<argument_type> options) {
+    task_queue_.set_options(std::move(options));
+  }
+
+  TaskQueueOptions<argument_type> queue_options() const {
+    return task_queue_.options();
+  }
+
+  // Return number of dropped tasks
+  std::size_t dropped() const { return task_queue_.dropped(); }
+
+  // Return number of tasks replaced by a newer task with the same key
+  std::size_t coalesced() const { return task_queue_.coalesced(); }
+
+  // Return performance statistics (min, max, avg execution times). Execution
+  // time includes the time the task is suspended.
+  PerformanceStatistics performance_statistics() const override final {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return timings_;
+  }
+
+ protected:
+  // Re-implement this coroutine. Task stays valid until the coroutine
+  // completes.
+  virtual task_type run(argument_type const &task) = 0;
+
+  // Await until the descriptor is readable
+  detail::ready_awaiter readable(int fd) { return {*loop_, fd, EPOLLIN}; }
+
+  // Await until the descriptor is writable
+  detail::ready_awaiter writable(int fd) { return {*loop_, fd, EPOLLOUT}; }
+
+  // Await the delay
+  detail::delay_awaiter sleep_for(EventLoop::clock::duration delay) {
+    return {*loop_, delay};
+  }
+
+  // Await the result of a blocking function, e.g. a read of a file, run on
+  // the shared executor. Exceptions of the function are rethrown.
+  template <typename Function>
+  detail::offload_awaiter<std::decay_t<Function>> offload(
+      Function &&function) {
+    return {*loop_, *executor_, std::forward<Function>(function), {}, {}};
+  }
+
+  // Await the results of the services, called on the shared executor. See
+  // ServiceBroker::call.
+  template <typename R, typename... Args>
+  auto call(std::string name, Args... args) {
+    return offload([broker = this->broker_, name = std::move(name),
+                    args...]() mutable {
+      return broker->template call<R>(name, std::move(args)...);
+    });
+  }
+
+  // Discard the queued tasks and wait until the tasks in flight complete and
+  // signal their results. Call it in the destructor of the most-derived
+  // worker, while run is still there. Must not be called on the loop thread.
+  void stop() {
+    stopped_ = true;
+    task_queue_.close();
+    std::unique_lock<std::mutex> lk(mtx_);
+    idle_.wait(lk, [this]() { return active_ == 0; });
+  }
+
+  // Queue the task and schedule the loop
+  void push_(argument_type task) {
+    tracing::span span(tracing::current(), "enqueue", this->trace_name_);
+    if (task_queue_.push_back(std::move(task))) {
+      schedule_();
+    }
+  }
+
+ private:
+  // Post a start of the queued tasks and of the configuration to the loop,
+  // unless one is posted
+  void schedule_() {
+    if (scheduled_.exchange(true)) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      ++active_;
+    }
+    loop_->post([this]() { start_(); });
+  }
+
+  // Apply the configuration and start queued tasks until max_in_flight are in
+  // flight. Runs on the loop.
+  void start_() {
+    scheduled_ = false;
+    {
+      std::lock_guard<std::mutex> lk(this->configuration_mtx_);
+      this->update_configuration();
+    }
+    while (in_flight_ < max_in_flight_) {
+      argument_type task;
+      TaskStamp stamp;
+      if (task_queue_.try_pull_front(task, &stamp) !=
+          queue_op_status::success) {
+        break;
+      }
+      this->report_dropped(task_queue_.dropped());
+      ++in_flight_;
+      {
+        std::lock_guard<std::mutex> lk(mtx_);
+        ++active_;
+      }
+      process_(std::move(task), stamp, sequence_++);
+    }
+    release_();
+  }
+
+  // Run the task and signal its result. Runs on the loop.
+  detail::detached_task process_(argument_type task, TaskStamp stamp,
+                                 std::size_t sequence) {
+    auto start_time = std::chrono::steady_clock::now();
+    tracing::record(stamp.trace, "dequeue", this->trace_name_, stamp.queued,
+                    start_time);
+    try {
+      auto value = co_await run(task);
+      auto end_time = std::chrono::steady_clock::now();
+      {
+        std::lock_guard<std::mutex> lk(mtx_);
+        timings_.update(end_time - start_time);
+      }
+      this->latency_.queue_wait.record(start_time - stamp.queued);
+      this->latency_.execution.record(end_time - start_time);
+      this->latency_.end_to_end.record(end_time - stamp.queued);
+      tracing::record(stamp.trace, "execute", this->trace_name_, start_time,
+                      end_time);
+
+      // Result continues the trace of its task
+      tracing::scoped_context context(stamp.trace);
+      tracing::span span(stamp.trace, "emit", this->trace_name_);
+      if (!sequenced_result_signal.service->empty()) {
+        sequenced_result_signal(Sequenced<result_type>{sequence, value});
+      }
+      result_signal.emit(std::move(value));
+    } catch (...) {
+      this->error(std::current_exception());
+    }
+    --in_flight_;
+    if (!task_queue_.empty()) {
+      schedule_();
+    }
+    release_();
+  }
+
+  // Completion of a posted start or of a task
+  void release_() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (--active_ == 0) {
+      idle_.notify_all();
+    }
+  }
+
+ protected:
+  TaskQueue<argument_type> task_queue_;
+
+ private:
+  std::shared_ptr<EventLoop> loop_;
+  std::shared_ptr<Executor> executor_;
+  std::atomic<std::size_t> max_in_flight_{1024};
+  std::atomic<std::size_t> in_flight_{0};
+  // Set while a start of the queued tasks is posted
+  std::atomic<bool> scheduled_{false};
+  // Sequence number of the next task, used on the loop only
+  std::size_t sequence_ = 0;
+  // Set by stop(), which the destructor checks
+  bool stopped_ = false;
+  // Guards the timings and the number of posted starts and tasks in flight,
+  // which the destructor waits for
+  mutable std::mutex mtx_;
+  std::condition_variable idle_;
+  std::size_t active_ = 0;
+  // Measure execution time
+  PerformanceStatistics timings_;
+};
+
+#endif
@@ -1,30 +1,44 @@
 #ifndef WORKER_MULTI_THREADED_HPP
 #define WORKER_MULTI_THREADED_HPP
 
+#include <boost/optional.hpp>
 #include <boost/signals2.hpp>
-#include <threadpool/ThreadedQueue.hpp>
-#include <threadpool/ContextPool.hpp>
-#include <threadpool/ExecutorPool.hpp>
 
 #include "detail/type_constraints.hpp"
 
+#include "ContextExecutor.hpp"
+#include "TaskQueue.hpp"
+#include "ThreadingPolicy.hpp"
 #include "WorkerBase.hpp"
 #include "ServiceBroker.hpp"
 
 /// <summary>
 /// WorkerMultiThreaded provides execution platform that allows for
 /// multithreaded execution of the tasks, where each task has its own execution
-/// context.
+/// context. Number of executors is set by ExecutorOptions and may follow the
+/// load. With the SharedScheduler policy, pre-processing, post-processing and
+/// the tasks run on the shared executor. Pre-processing and post-processing
+/// run on their own threads but never at the same time, so that they may
+/// share state without a lock. Derived classes must call stop() in their
+/// destructor, so that preprocess and postprocess are not called while they
+/// are destroyed and the pending results are signalled. A worker destroyed
+/// without stop() discards its pending tasks and results and reports them as
+/// an error on its log service.
 /// </summary>
 template <typename ArgumentType, typename ResultType, typename ContextType,
-          typename BrokerType, typename ConfigurationType>
+          typename BrokerType, typename ConfigurationType,
+          typename ThreadingPolicy = DedicatedThreads>
 class WorkerMultiThreadedT : public WorkerBaseT<BrokerType, ConfigurationType> {
  public:
   using Base = WorkerBaseT<BrokerType, ConfigurationType>;
   using argument_type = ArgumentType;
   using result_type = ResultType;
   using context_type = ContextType;
-  using context_pool_type = context_pool<ContextType>;
+  using threading_policy = ThreadingPolicy;
+  using executor_type =
+      typename ThreadingPolicy::template context_executor_type<ContextType>;
+  // Provides argument_type and result_type of the contexts
+  using context_pool_type = executor_type;
   using broker_type = BrokerType;
   using configuration_type = ConfigurationType;
 
@@ -33,31 +47,50 @@ class WorkerMultiThreadedT : public WorkerBaseT<BrokerType, ConfigurationType> {
 
   // Signal result
   Service<void, result_type> result_signal = {this->worker_name_ + ".result"};
+  // Signal result with the sequence number of the task which produced it, so
+  // that the results can be reordered when ExecutorOptions::ordered is off.
+  // Tasks are numbered in the order of scheduling.
+  Service<void, Sequenced<result_type>> sequenced_result_signal = {
+      this->worker_name_ + ".sequenced_result"};
 
  public:
   // Default constructor
   WorkerMultiThreadedT(std::string const &worker_name,
                        std::shared_ptr<BrokerType> broker)
-      : Base(worker_name, broker),
-        context_pool_(new context_pool_type()),
-        executors_(4, context_pool_),
-        terminate_(false) {
-    // Add service result to the broker
-    this->add_service(result_signal);
-    // Start thread that performs preprocessing and post-processing
-    worker_thread_ = std::thread([this]() { run_(); });
-  }
+      : WorkerMultiThreadedT(worker_name, broker, {}) {}
 
-  // Inherit default constructor and connect input to all signals in the input
+  // Connect input to all signals in the input. Number of executors is set by
+  // the options.
   WorkerMultiThreadedT(std::string const &worker_name,
                        std::shared_ptr<BrokerType> broker,
-                       std::vector<std::string> const &inputs)
-      : WorkerMultiThreadedT(worker_name, broker) {
+                       std::vector<std::string> const &inputs,
+                       ExecutorOptions options = ExecutorOptions())
+      : Base(worker_name, broker), executors_(options) {
+    // Add service result to the broker
+    this->add_service(result_signal, sequenced_result_signal);
+    // Contexts read the configuration snapshots of the worker
+    executors_.configure(
+        [configuration = this->configuration_](context_type &context) {
+          context.share_configuration(configuration);
+        });
+    // Start pre-processing and post-processing
+    executors_.set_on_timing([this](TaskTiming const &timing) {
+      this->latency_.queue_wait.record(timing.start - timing.origin);
+      this->latency_.execution.record(timing.end - timing.start);
+      tracing::record(timing.trace, "execute", this->trace_name_,
+                      timing.start, timing.end);
+    });
+    executors_.set_on_complete([this]() { postprocess_runner_.notify(); });
+    preprocess_runner_.start(
+        [this](bool wait) { return preprocess_step_(wait); });
+    postprocess_runner_.start(
+        [this](bool wait) { return postprocess_step_(wait); });
+
     // Connect to all inputs
     for (const auto &input : inputs) {
-      this->register_callback(
-          input + ".result",
-          [this, &input](argument_type task) { task_queue_.push_back(task); });
+      this->register_callback(input + ".result", [this](argument_type task) {
+        push_(std::move(task));
+      });
     }
   }
 
@@ -69,24 +102,77 @@ class WorkerMultiThreadedT : public WorkerBaseT<BrokerType, ConfigurationType> {
       : WorkerMultiThreadedT(worker_name, broker) {
     static_assert(detail::are_valid_services<InputServices...>::value,
                   "Invalid input. Input should be of type Service.");
-    register_callback(
-        [this](argument_type const &task) { task_queue_.push_back(task); },
-        std::forward<InputServices>(inputs)...);
+    this->register_callback(
+        [this](argument_type task) { push_(std::move(task)); },
+        inputs...);
   }
 
+  // Stop the threads. Results of the scheduled tasks are discarded, since
+  // preprocess and postprocess of the derived class are gone; see stop().
   ~WorkerMultiThreadedT() {
-    this->remove_service(result_signal);
+    this->remove_service(result_signal, sequenced_result_signal);
     terminate_ = true;
-    worker_thread_.join();
+    auto discarded = stopped_ ? 0 : task_queue_.size() + unfinished_;
+    stop_();
+    if (discarded != 0) {
+      this->log({Log::Severity::Error,
+                 std::to_string(discarded) + " tasks discarded by " +
+                     this->worker_name_ + ", destroyed without stop()"});
+    }
   }
 
-  // Set configuration for all contexts
-  void set_configuration(configuration_type configuration) override final {
-    for (auto context : context_pool_->contexts()) {
-      context->set_configuration(configuration);
-    }
-    Base::set_configuration(configuration);
-  };
+  // Change the number of executors, switch the adaptive mode or the order of
+  // the results
+  void set_executor_options(ExecutorOptions options) {
+    executors_.set_options(options);
+  }
+
+  ExecutorOptions executor_options() const { return executors_.options(); }
+
+  // Bound the task queue. The number of tasks scheduled to the executors is
+  // bounded by the same capacity, so that the tasks do not pile up in the
+  // executors instead. Tasks dropped by a full queue are counted and reported
+  // as warnings on the log service.
+  void set_queue_options(TaskQueueOptions<argument_type> options) {
+    auto executor_options = executors_.options();
+    executor_options.max_pending = options.capacity;
+    executors_.set_options(executor_options);
+    task_queue_.set_options(std::move(options));
+  }
+
+  TaskQueueOptions<argument_type> queue_options() const {
+    return task_queue_.options();
+  }
+
+  // Return number of dropped tasks
+  std::size_t dropped() const { return task_queue_.dropped(); }
+
+  // Return number of tasks replaced by a newer task with the same key
+  std::size_t coalesced() const { return task_queue_.coalesced(); }
+
+  // Return number of executors
+  std::size_t executors() const { return executors_.size(); }
+
+  // Pin the pre-processing, post-processing and executor threads. Has no
+  // effect with the SharedScheduler policy.
+  void set_placement(Placement placement) override {
+    preprocess_runner_.set_placement(placement);
+    postprocess_runner_.set_placement(placement);
+    auto options = executors_.options();
+    options.placement = std::move(placement);
+    executors_.set_options(options);
+  }
+
+  std::vector<ThreadPlacement> topology() const override {
+    auto result =
+        preprocess_runner_.topology(this->worker_name_ + ".preprocess");
+    auto postprocess =
+        postprocess_runner_.topology(this->worker_name_ + ".postprocess");
+    auto executors = executors_.topology(this->worker_name_);
+    result.insert(result.end(), postprocess.begin(), postprocess.end());
+    result.insert(result.end(), executors.begin(), executors.end());
+    return result;
+  }
 
   // Return number of pending tasks
   std::size_t pending() const noexcept { return executors_.pending(); }
@@ -102,65 +188,158 @@ class WorkerMultiThreadedT : public WorkerBaseT<BrokerType, ConfigurationType> {
   // Retrieve the data from
   //  the executor pool and perform post-processing
   virtual result_type postprocess(
-      typename context_pool_type::result_type &&arg) = 0;
+      typename executor_type::result_type &&arg) = 0;
+
+  // Stop accepting tasks, wait for the scheduled tasks and signal their
+  // results. Call it in the destructor of the most derived class to drain the
+  // worker; the base destructor discards the pending results.
+  void stop() { stop_(); }
 
-  // Schedule task for execution
-  void schedule(typename context_pool_type::argument_type const &task) {
-    executors_.schedule_task(task);
+  // Schedule task for execution. Latency of the task is measured from the
+  // arrival of the input task which is pre-processed.
+  void schedule(typename executor_type::argument_type const &task) {
+    ++unfinished_;
+    try {
+      executors_.schedule_task(task, stamp_.queued, stamp_.trace);
+    } catch (...) {
+      --unfinished_;
+      throw;
+    }
+  }
+
+  // Queue the task and schedule pre-processing
+  void push_(argument_type task) {
+    tracing::span span(tracing::current(), "enqueue", this->trace_name_);
+    task_queue_.push_back(std::move(task));
+    preprocess_runner_.notify();
+  }
+
+  // Pull a task from the input queue and pre-process it. All tasks must be
+  // scheduled for execution in the pre-processing step. This decision was
+  // made to enable user to split larger input tasks into many smaller tasks.
+  // Returns false if there is no task.
+  bool preprocess_step_(bool wait) {
+    argument_type task;
+    if (wait ? !task_queue_.pull_front(task, &stamp_)
+             : task_queue_.try_pull_front(task, &stamp_) !=
+                   queue_op_status::success) {
+      return false;
+    }
+    if (terminate_) {
+      return false;
+    }
+    try {
+      this->report_dropped(task_queue_.dropped());
+      if (stamp_.trace) {
+        tracing::record(stamp_.trace, "dequeue", this->trace_name_,
+                        stamp_.queued, std::chrono::steady_clock::now());
+      }
+      tracing::scoped_context context(stamp_.trace);
+      tracing::span span(stamp_.trace, "preprocess", this->trace_name_);
+      std::lock_guard<std::mutex> lk(this->configuration_mtx_);
+      this->update_configuration();
+      preprocess(task);
+    } catch (...) {
+      this->error(std::current_exception());
+    }
+    return true;
   }
 
-  // Pull data from the input queue, pre- and post-process it. All
-  // tasks must be scheduled for execution in the pre-processing step. This
-  // decision was made to enable user to split larger input tasks into many
-  // smaller tasks.
-  void run_() {
-    while (!terminate_) {
-      try {
-        // Update deferred configuration
-        if (this->configuration_changed_) {
-          // It is safe to change configuration when pre- and post-processing is
-          // not running.
-          this->update_configuration();
-        }
-
-        // Preprocess and schedule tasks
-        argument_type task;
-        if (task_queue_.try_pull_front(task) == queue_op_status::success) {
-          std::lock_guard<std::mutex> lk(this->configuration_mtx_);
-          preprocess(task);
-        }
-        // Post-process tasks and signal result
-        std::future<typename context_pool_type::result_type> result;
-        if (executors_.result_queue.try_pull_front(result) ==
-            queue_op_status::success) {
-          std::lock_guard<std::mutex> lk(this->configuration_mtx_);
-          result_signal(postprocess(result.get()));
-        }
-        // Maybe we should execute this in two separate threads with conditional
-        // variable for waking up?
-        std::this_thread::sleep_for(std::chrono::microseconds(50));
-      } catch (...) {
-        this->error(std::current_exception());
+  // Pull the next result, post-process it and signal the result. Returns
+  // false if the result is not ready. If wait is set, waits for the result
+  // and returns false once the worker stops.
+  bool postprocess_step_(bool wait) {
+    if (terminate_) {
+      return false;
+    }
+    if (!next_result_) {
+      sequenced_future_type result;
+      if (wait) {
+        result = executors_.result_queue.pull_front();
+      } else if (executors_.result_queue.try_pull_front(result) !=
+                 queue_op_status::success) {
+        return false;
       }
+      if (!result.value.valid() || terminate_) {
+        return false;
+      }
+      next_result_ = std::move(result);
+    }
+    if (!wait && next_result_->value.wait_for(std::chrono::seconds(0)) !=
+                     std::future_status::ready) {
+      return false;
+    }
+    auto result = std::move(*next_result_);
+    next_result_ = boost::none;
+    // Destructor may have started while the task was running
+    result.value.wait();
+    if (terminate_) {
+      return false;
+    }
+    try {
+      tracing::scoped_context context(result.trace);
+      result_type value;
+      {
+        tracing::span span(result.trace, "postprocess", this->trace_name_);
+        std::lock_guard<std::mutex> lk(this->configuration_mtx_);
+        this->update_configuration();
+        value = postprocess(result.value.get());
+      }
+      this->latency_.end_to_end.record(std::chrono::steady_clock::now() -
+                                       result.origin);
+      tracing::span span(result.trace, "emit", this->trace_name_);
+      if (!sequenced_result_signal.service->empty()) {
+        sequenced_result_signal(Sequenced<result_type>{result.sequence, value});
+      }
+      result_signal.emit(std::move(value));
+    } catch (...) {
+      this->error(std::current_exception());
     }
+    --unfinished_;
+    return true;
   }
 
  protected:
   // Module's task queue.
-  threaded_queue<argument_type> task_queue_;
+  TaskQueue<argument_type> task_queue_;
 
  private:
-  // Context pool provides context for executions, i.e. provides function object
-  // classes.
-  std::shared_ptr<context_pool_type> context_pool_;
+  using sequenced_future_type =
+      ScheduledResult<typename executor_type::result_type>;
+
+  // Stop pre-processing, then post-processing once it has signalled the
+  // results of the scheduled tasks. Runs once.
+  void stop_() {
+    if (stopped_) {
+      return;
+    }
+    stopped_ = true;
+    task_queue_.close();
+    preprocess_runner_.stop();
+    // Invalid future wakes up and stops post-processing
+    executors_.result_queue.push_back(sequenced_future_type::stop_marker());
+    postprocess_runner_.stop();
+  }
+
+  // Set by the destructor. Pending tasks and results are discarded.
+  std::atomic<bool> terminate_{false};
+  bool stopped_ = false;
+  // Scheduled tasks whose results were not signalled yet
+  std::atomic<std::size_t> unfinished_{0};
 
-  // Executor pool executes tasks in contexts
-  executor_pool<context_pool_type> executors_;
+  // Pre-process the tasks and schedule them for execution, on their own
+  // threads or on the shared executor. Declared before the executors, which
+  // notify the post-processing until they are destroyed.
+  typename ThreadingPolicy::runner_type preprocess_runner_;
+  // Post-process the results and signal them
+  typename ThreadingPolicy::runner_type postprocess_runner_;
+  // Stamp of the task which is pre-processed
+  TaskStamp stamp_;
+  // Result which was pulled from the result queue but is not ready yet
+  boost::optional<sequenced_future_type> next_result_;
 
-  // Terminate thread that performs pre- and post-processing
-  std::atomic<bool> terminate_;
-  // Thread that performs pre and post-processing in the module
-  std::thread worker_thread_;
+  // Executes tasks, each executor in its own context
+  executor_type executors_;
 };
 
 #endif
@@ -1,16 +1,38 @@
 #ifndef WORKER_SINGLE_THREADED_HPP
 #define WORKER_SINGLE_THREADED_HPP
 
-#include <boost/signals2.hpp>
+#include <algorithm>
+#include <chrono>
+#include <vector>
 
-#include <threadpool/ThreadedQueue.hpp>
+#include <boost/signals2.hpp>
 
 #include "detail/type_constraints.hpp"
 #include "ServiceBroker.hpp"
+#include "TaskQueue.hpp"
+#include "ThreadingPolicy.hpp"
 #include "WorkerBase.hpp"
 
+template <typename BrokerType>
+class PipelineT;
+
+/** Batching of the tasks in WorkerSingleThreaded. Worker takes up to max_size
+ * queued tasks and waits up to max_delay for more tasks to arrive, before it
+ * runs them as a single batch. With the SharedScheduler policy, the worker
+ * does not wait and max_delay is ignored. */
+struct BatchOptions {
+  std::size_t max_size = 1;
+  std::chrono::microseconds max_delay{0};
+  // Signal the results of a batch at once on batch_result_signal, instead of
+  // one by one on result_signal
+  bool emit_batch = false;
+};
+
+/** Runs the tasks one at a time, on its own thread or, with the
+ * SharedScheduler policy, on the shared executor. */
 template <typename ArgumentType, typename ResultType, typename BrokerType,
-          typename ConfigurationType>
+          typename ConfigurationType,
+          typename ThreadingPolicy = DedicatedThreads>
 class WorkerSingleThreadedT
     : public WorkerBaseT<BrokerType, ConfigurationType> {
  public:
@@ -19,17 +41,22 @@ class WorkerSingleThreadedT
   using result_type = ResultType;
   using broker_type = BrokerType;
   using configuration_type = ConfigurationType;
+  using threading_policy = ThreadingPolicy;
 
   static_assert(std::is_default_constructible<result_type>::value,
                 "ResultType must be default constructible.");
 
   Service<void, result_type> result_signal = {this->worker_name_ + ".result"};
+  // Signal all the results of a batch at once. Added to the broker only while
+  // BatchOptions::emit_batch is set.
+  Service<void, std::vector<result_type>> batch_result_signal = {
+      this->worker_name_ + ".batch_result"};
 
  public:
   WorkerSingleThreadedT(std::string const &worker_name,
                         std::shared_ptr<BrokerType> broker)
       : Base(worker_name, broker), terminate_(false) {
-    worker_thread_ = std::thread([this]() { run_(); });
+    runner_.start([this](bool wait) { return step_(wait); });
     this->add_service(result_signal);
   }
 
@@ -38,9 +65,9 @@ class WorkerSingleThreadedT
                         std::vector<std::string> const &inputs)
       : WorkerSingleThreadedT(worker_name, broker) {
     for (const auto &input : inputs) {
-      this->register_callback(
-          input + ".result",
-          [this, &input](argument_type task) { task_queue_.push_back(task); });
+      this->register_callback(input + ".result", [this](argument_type task) {
+        push_(std::move(task));
+      });
     }
   }
 
@@ -52,67 +79,239 @@ class WorkerSingleThreadedT
     static_assert(detail::are_valid_services<InputServices...>::value,
                   "Invalid input. Input should be of type Service.");
     this->register_callback(
-        [this](argument_type const &task) { task_queue_.push_back(task); },
+        [this](argument_type task) { push_(std::move(task)); },
         std::forward<InputServices>(inputs)...);
   }
 
   ~WorkerSingleThreadedT() {
     this->remove_service(result_signal);
+    if (batch_options().emit_batch) {
+      this->remove_service(batch_result_signal);
+    }
     terminate_ = true;
-    task_queue_.push_back(argument_type());
-    worker_thread_.join();
+    task_queue_.close();
+    runner_.stop();
   }
 
   std::size_t pending() const noexcept { return task_queue_.size(); }
 
-  // Return performance statistics (min, max, avg execution times)
+  // Bound the task queue. Tasks dropped by a full queue are counted and
+  // reported as warnings on the log service.
+  void set_queue_options(TaskQueueOptions<argument_type> options) {
+    task_queue_.set_options(std::move(options));
+  }
+
+  TaskQueueOptions<argument_type> queue_options() const {
+    return task_queue_.options();
+  }
+
+  // Return number of dropped tasks
+  std::size_t dropped() const { return task_queue_.dropped(); }
+
+  // Return number of tasks replaced by a newer task with the same key
+  std::size_t coalesced() const { return task_queue_.coalesced(); }
+
+  // Pin the worker thread. Has no effect with the SharedScheduler policy.
+  void set_placement(Placement placement) override {
+    runner_.set_placement(std::move(placement));
+  }
+
+  std::vector<ThreadPlacement> topology() const override {
+    return runner_.topology(this->worker_name_);
+  }
+
+  // Return performance statistics (min, max, avg execution times). With
+  // batching, the execution times are measured per batch, in the latency
+  // metrics as well.
   PerformanceStatistics performance_statistics() const override final { return timings_; }
 
+  void set_batch_options(BatchOptions options) {
+    std::lock_guard<std::mutex> lk(batch_mtx_);
+    if (options.emit_batch && !batch_options_.emit_batch) {
+      this->add_service(batch_result_signal);
+    } else if (!options.emit_batch && batch_options_.emit_batch) {
+      this->remove_service(batch_result_signal);
+    }
+    batch_options_ = options;
+  }
+
+  BatchOptions batch_options() const {
+    std::lock_guard<std::mutex> lk(batch_mtx_);
+    return batch_options_;
+  }
+
+  // Whether the tasks run on the thread which delivers them, see Pipeline
+  bool fused() const noexcept { return fused_; }
+
  protected:
   virtual result_type run(argument_type const &) {
     std::this_thread::yield();
     return result_type();
   }
 
-  void run_() {
-    while (!terminate_) {
-      try {
-        // Update deferred configuration
-        if (this->configuration_changed_) {
-          this->update_configuration();
-        }
-        auto task = task_queue_.pull_front();
-
-        // TODO: Implement this with conditional_variable
-        if (!terminate_) {
-          // Lock changes to configuration
-          std::lock_guard<std::mutex> lk(this->configuration_mtx_);
-
-          // Measure execution time
-          auto start_time = std::chrono::high_resolution_clock::now();
-          // Execute task
-          auto result = run(task);
-          auto end_time = std::chrono::high_resolution_clock::now();
-          timings_.update(end_time - start_time);
-
-          // Signal result to the connected callbacks
-          result_signal(result);
+  // Re-implement this function to process the batches more efficiently
+  virtual std::vector<result_type> run_batch(
+      std::vector<argument_type> const &tasks) {
+    std::vector<result_type> results;
+    results.reserve(tasks.size());
+    for (auto const &task : tasks) {
+      results.emplace_back(run(task));
+    }
+    return results;
+  }
+
+  // Queue the task and schedule the worker, or run it if the worker is fused
+  void push_(argument_type task) {
+    if (!fused_) {
+      {
+        tracing::span span(tracing::current(), "enqueue", this->trace_name_);
+        if (task_queue_.push_back(std::move(task))) {
+          runner_.notify();
+          return;
         }
-      } catch (std::exception &e) {
-        this->error(std::make_exception_ptr(e));
+      }
+      // Queue which was closed by the fusion leaves the task to the caller
+      if (!fused_ || terminate_) {
+        return;
       }
     }
+    run_fused_(std::move(task));
+  }
+
+  // Run the next batch of tasks. Returns false if there is none.
+  bool step_(bool wait) {
+    // Batch options may change while the worker waits
+    if (wait && !task_queue_.wait()) {
+      return false;
+    }
+    try {
+      auto options = batch_options();
+      auto max_size = std::max<std::size_t>(options.max_size, 1u);
+      tasks_.clear();
+      stamps_.clear();
+      if (wait ? !task_queue_.pull_front(tasks_, max_size, options.max_delay,
+                                         &stamps_)
+               : !task_queue_.try_pull_front(tasks_, max_size, &stamps_)) {
+        return false;
+      }
+      this->report_dropped(task_queue_.dropped());
+
+      if (!terminate_) {
+        execute_(tasks_, stamps_, options.emit_batch);
+      }
+    } catch (std::exception &e) {
+      this->error(std::make_exception_ptr(e));
+    }
+    return true;
+  }
+
+  // Run the task on the calling thread, without the queue
+  void run_fused_(argument_type task) {
+    std::vector<argument_type> tasks;
+    tasks.emplace_back(std::move(task));
+    std::vector<TaskStamp> stamps{
+        {std::chrono::steady_clock::now(), tracing::current()}};
+    std::lock_guard<std::mutex> lk(fused_mtx_);
+    if (terminate_) {
+      return;
+    }
+    try {
+      execute_(tasks, stamps, false);
+    } catch (std::exception &e) {
+      this->error(std::make_exception_ptr(e));
+    }
+  }
+
+  // Run the tasks on the thread which delivers them from now on. The queue is
+  // closed and the runner stopped once it completes its batch, then the tasks
+  // left in the queue run on the calling thread, so that the tasks keep their
+  // order. Must not be called from the worker's thread.
+  void fuse_() {
+    std::lock_guard<std::mutex> lk(fused_mtx_);
+    if (fused_) {
+      return;
+    }
+    fused_ = true;
+    std::vector<argument_type> tasks;
+    std::vector<TaskStamp> stamps;
+    task_queue_.close(tasks, &stamps);
+    runner_.stop();
+    if (tasks.empty() || terminate_) {
+      return;
+    }
+    try {
+      execute_(tasks, stamps, false);
+    } catch (std::exception &e) {
+      this->error(std::make_exception_ptr(e));
+    }
+  }
+
+  // Run the batch and signal its results, at once or one by one
+  void execute_(std::vector<argument_type> const &tasks,
+                std::vector<TaskStamp> const &stamps, bool emit_batch) {
+    std::vector<result_type> results;
+    std::chrono::steady_clock::time_point start_time, end_time;
+    {
+      // Configuration changes wait until the tasks have run
+      std::lock_guard<std::mutex> lk(this->configuration_mtx_);
+      this->update_configuration();
+      // Measure execution time
+      start_time = std::chrono::steady_clock::now();
+      // Execute tasks
+      results = run_batch(tasks);
+      end_time = std::chrono::steady_clock::now();
+    }
+    timings_.update(end_time - start_time);
+    this->latency_.execution.record(end_time - start_time);
+    for (auto const &stamp : stamps) {
+      this->latency_.queue_wait.record(start_time - stamp.queued);
+      this->latency_.end_to_end.record(end_time - stamp.queued);
+      tracing::record(stamp.trace, "dequeue", this->trace_name_, stamp.queued,
+                      start_time);
+      tracing::record(stamp.trace, "execute", this->trace_name_, start_time,
+                      end_time);
+    }
+
+    // Signal results to the connected callbacks
+    if (emit_batch) {
+      // Batch continues the trace of its first task
+      auto trace = stamps.empty() ? TraceContext() : stamps.front().trace;
+      tracing::scoped_context context(trace);
+      tracing::span span(trace, "emit", this->trace_name_);
+      batch_result_signal.emit(std::move(results));
+      return;
+    }
+    // Results continue the traces of their tasks
+    for (std::size_t i = 0; i < results.size(); ++i) {
+      auto trace = i < stamps.size() ? stamps[i].trace : TraceContext();
+      tracing::scoped_context context(trace);
+      tracing::span span(trace, "emit", this->trace_name_);
+      result_signal.emit(std::move(results[i]));
+    }
   }
 
  protected:
-  threaded_queue<argument_type> task_queue_;
+  TaskQueue<argument_type> task_queue_;
 
  private:
   // Terminate main service thread which performs pre- and post-processing.
   std::atomic<bool> terminate_;
-  // Main service thread which performs pre- and post-processing.
-  std::thread worker_thread_;
+  // Runs the tasks on the worker's thread or on the shared executor
+  typename ThreadingPolicy::runner_type runner_;
+  // Batch being executed and the stamps of its tasks
+  std::vector<argument_type> tasks_;
+  std::vector<TaskStamp> stamps_;
+  // Set once the tasks run on the delivering threads. Guards the fused
+  // execution, which may be called from several threads.
+  std::atomic<bool> fused_{false};
+  std::mutex fused_mtx_;
   // Measure execution time
   PerformanceStatistics timings_;
+  // Batching of the tasks
+  BatchOptions batch_options_;
+  mutable std::mutex batch_mtx_;
+
+  template <typename>
+  friend class PipelineT;
 };
 #endif
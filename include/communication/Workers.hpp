@@ -8,21 +8,36 @@
 #include "WorkerSingleThreaded.hpp"
 #include "WorkerMultiThreaded.hpp"
 #include "ContextBase.hpp"
+#include "Pipeline.hpp"
+#if defined(__cpp_impl_coroutine)
+#include "WorkerCoroutine.hpp"
+#endif
 
 using configuration_type = cxml::CXml;
 
 using WorkerBase = WorkerBaseT<ServiceBroker, configuration_type>;
 
-template <typename ArgumentType, typename ResultType>
+template <typename ArgumentType, typename ResultType,
+          typename ThreadingPolicy = DedicatedThreads>
 using WorkerSingleThreaded =
-    WorkerSingleThreadedT<ArgumentType, ResultType, ServiceBroker, configuration_type>;
+    WorkerSingleThreadedT<ArgumentType, ResultType, ServiceBroker,
+                          configuration_type, ThreadingPolicy>;
 
-template <typename ArgumentType, typename ResultType, typename ContextType>
+template <typename ArgumentType, typename ResultType, typename ContextType,
+          typename ThreadingPolicy = DedicatedThreads>
 using WorkerMultiThreaded =
     WorkerMultiThreadedT<ArgumentType, ResultType, ContextType, ServiceBroker,
-                         configuration_type>;
+                         configuration_type, ThreadingPolicy>;
+
+#if defined(__cpp_impl_coroutine)
+template <typename ArgumentType, typename ResultType>
+using WorkerCoroutine = WorkerCoroutineT<ArgumentType, ResultType,
+                                         ServiceBroker, configuration_type>;
+#endif
 
 template <typename ArgumentType, typename ResultType>
 using ContextBase = ContextBaseT<ArgumentType, ResultType, configuration_type>;
 
+using Pipeline = PipelineT<ServiceBroker>;
+
 #endif
@@ -0,0 +1,194 @@
+#ifndef COMMUNICATION_EPOCH_HPP
+#define COMMUNICATION_EPOCH_HPP
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+namespace detail {
+// Epoch based reclamation of objects shared between threads. Readers mark the
+// epoch in which they entered the read-side section in a per-thread slot,
+// which costs a single store and requires no lock. Writers publish a new
+// object, retire the old one and delete it once all readers that could
+// still observe it have left their sections. Retired objects are deleted by
+// the next retire or by the reader which leaves its section last.
+class epoch {
+ public:
+  // Enter the read-side section. Sections may be nested.
+  static void enter() noexcept {
+    auto &r = local();
+    if (r.nesting++ == 0) {
+      r.epoch.store(global().load(std::memory_order_seq_cst),
+                    std::memory_order_seq_cst);
+    }
+  }
+
+  // Leave the read-side section. Deletes the retired objects which are not
+  // observed anymore, unless another thread is deleting them.
+  static void leave() noexcept {
+    auto &r = local();
+    if (--r.nesting == 0) {
+      r.epoch.store(0, std::memory_order_seq_cst);
+      if (get_registry().pending.load(std::memory_order_relaxed) != 0) {
+        try {
+          reclaim(false);
+        } catch (...) {
+          // Objects stay retired until the next reclamation
+        }
+      }
+    }
+  }
+
+  // Delete the object when no reader can observe it anymore. The object must
+  // be unreachable for new readers before it is retired.
+  template <typename T>
+  static void retire(T const *object) {
+    if (object) {
+      retire(std::function<void()>([object]() { delete object; }));
+    }
+  }
+
+  static void retire(std::function<void()> deleter) {
+    auto &reg = get_registry();
+    {
+      std::lock_guard<std::mutex> lk(reg.mtx);
+      reg.retired.emplace_back(
+          global().fetch_add(1, std::memory_order_seq_cst), std::move(deleter));
+      reg.pending = reg.retired.size();
+    }
+    reclaim();
+  }
+
+  // Delete all retired objects which are not observed by any reader. Returns
+  // at once if wait is not set and another thread holds the registry.
+  static void reclaim(bool wait = true) {
+    std::vector<std::function<void()>> deleters;
+    {
+      auto &reg = get_registry();
+      std::unique_lock<std::mutex> lk(reg.mtx, std::defer_lock);
+      if (wait) {
+        lk.lock();
+      } else if (!lk.try_lock()) {
+        return;
+      }
+      auto oldest = std::numeric_limits<std::uint64_t>::max();
+      for (auto r : reg.readers) {
+        auto e = r->epoch.load(std::memory_order_seq_cst);
+        if (e != 0) {
+          oldest = std::min(oldest, e);
+        }
+      }
+      auto it = std::partition(
+          reg.retired.begin(), reg.retired.end(),
+          [oldest](retired_type const &r) { return r.first >= oldest; });
+      for (auto d = it; d != reg.retired.end(); ++d) {
+        deleters.emplace_back(std::move(d->second));
+      }
+      reg.retired.erase(it, reg.retired.end());
+      reg.pending = reg.retired.size();
+    }
+    for (auto &deleter : deleters) {
+      deleter();
+    }
+  }
+
+ private:
+  // Padded to a cache line, so that the readers of different threads do not
+  // share one
+  struct reader {
+    std::atomic<std::uint64_t> epoch{0};
+    unsigned nesting = 0;
+    char padding[64 - sizeof(std::atomic<std::uint64_t>) - sizeof(unsigned)];
+  };
+
+  // Epoch in which the object was retired, deleter
+  using retired_type = std::pair<std::uint64_t, std::function<void()>>;
+
+  struct registry {
+    ~registry() {
+      for (auto &r : retired) {
+        r.second();
+      }
+    }
+
+    std::mutex mtx;
+    std::vector<reader *> readers;
+    std::vector<retired_type> retired;
+    // Number of retired objects, checked by the readers without the lock
+    std::atomic<std::size_t> pending{0};
+  };
+
+  // Registers the reader slot of the thread and removes it on thread exit
+  struct reader_handle {
+    reader_handle() : reg(get_registry()), r(new reader) {
+      std::lock_guard<std::mutex> lk(reg.mtx);
+      reg.readers.push_back(r.get());
+    }
+    ~reader_handle() {
+      std::lock_guard<std::mutex> lk(reg.mtx);
+      reg.readers.erase(std::find(reg.readers.begin(), reg.readers.end(),
+                                  r.get()));
+    }
+
+    registry &reg;
+    std::unique_ptr<reader> r;
+  };
+
+  // Epoch zero marks a reader outside of the read-side section.
+  static std::atomic<std::uint64_t> &global() noexcept {
+    static std::atomic<std::uint64_t> value{1};
+    return value;
+  }
+
+  static registry &get_registry() {
+    static registry reg;
+    return reg;
+  }
+
+  static reader &local() {
+    thread_local reader_handle handle;
+    return *handle.r;
+  }
+};
+
+// Read-side section for the lifetime of the guard
+struct epoch_guard {
+  epoch_guard() noexcept { epoch::enter(); }
+  ~epoch_guard() { epoch::leave(); }
+  epoch_guard(epoch_guard const &) = delete;
+  epoch_guard &operator=(epoch_guard const &) = delete;
+};
+
+// Pointer to an immutable object, which is replaced as a whole. Readers must
+// load the pointer and use the object inside the read-side section.
+template <typename T>
+class rcu_ptr {
+ public:
+  explicit rcu_ptr(std::unique_ptr<T> object) : ptr_(object.release()) {}
+  ~rcu_ptr() { epoch::retire(ptr_.load()); }
+
+  rcu_ptr(rcu_ptr const &) = delete;
+  rcu_ptr &operator=(rcu_ptr const &) = delete;
+
+  T const *load() const noexcept {
+    return ptr_.load(std::memory_order_seq_cst);
+  }
+
+  // Publish the new object and retire the old one
+  void store(std::unique_ptr<T> object) {
+    epoch::retire(ptr_.exchange(object.release(), std::memory_order_seq_cst));
+  }
+
+ private:
+  std::atomic<T const *> ptr_;
+};
+}
+
+#endif
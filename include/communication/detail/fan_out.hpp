@@ -0,0 +1,130 @@
+#ifndef COMMUNICATION_FAN_OUT_HPP
+#define COMMUNICATION_FAN_OUT_HPP
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+
+#include <boost/optional.hpp>
+
+#include "../Executor.hpp"
+#include "noncopyable.hpp"
+
+namespace detail {
+// Executes tasks on the executor and hands their results to the calling
+// thread in the order of completion. While waiting for the results, the
+// calling thread executes pending tasks of the executor. Tasks may refer to
+// the caller's stack, since fan_out waits for all of them before it is
+// destroyed.
+template <typename ResultType>
+class fan_out : noncopyable {
+ public:
+  explicit fan_out(Executor &executor)
+      : executor_(executor), pending_(0), cancelled_(false) {}
+
+  ~fan_out() {
+    while (next()) {
+    }
+  }
+
+  // Execute the task on the executor
+  template <typename Task>
+  void submit(std::size_t index, Task task) {
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      ++pending_;
+    }
+    executor_.submit([this, index, task]() { complete(index, task); });
+  }
+
+  // Execute the task on the calling thread
+  template <typename Task>
+  void run(std::size_t index, Task const &task) {
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      ++pending_;
+    }
+    complete(index, task);
+  }
+
+  // Wait for all the tasks and call consumer(index, result) on the calling
+  // thread for each result as it arrives. Consumer returns false to ignore
+  // the remaining results, in which case the tasks which have not started yet
+  // are skipped. Rethrows the first exception thrown by a task,
+  // after all the tasks have completed.
+  template <typename Consumer>
+  void consume(Consumer &&consumer) {
+    std::exception_ptr error;
+    bool active = true;
+    while (auto c = next()) {
+      if (c->error) {
+        error = error ? error : c->error;
+      } else if (active && !error) {
+        active = consumer(c->index, std::move(*c->result));
+        cancelled_ = !active;
+      }
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+ private:
+  struct completion {
+    std::size_t index;
+    boost::optional<ResultType> result;
+    std::exception_ptr error;
+  };
+
+  template <typename Task>
+  void complete(std::size_t index, Task const &task) {
+    completion c{index, boost::none, nullptr};
+    if (!cancelled_) {
+      try {
+        c.result = task();
+      } catch (...) {
+        c.error = std::current_exception();
+      }
+    }
+    // Notify while holding the lock, since the waiting thread may destroy
+    // fan_out as soon as it observes the last completion.
+    std::lock_guard<std::mutex> lk(mtx_);
+    done_.emplace_back(std::move(c));
+    --pending_;
+    cv_.notify_one();
+  }
+
+  // Wait for the next completion. Returns none when all tasks completed.
+  boost::optional<completion> next() {
+    std::unique_lock<std::mutex> lk(mtx_);
+    while (done_.empty()) {
+      if (pending_ == 0) {
+        return boost::none;
+      }
+      lk.unlock();
+      bool executed = executor_.try_run_one();
+      lk.lock();
+      if (!executed) {
+        cv_.wait(lk, [this]() { return !done_.empty() || pending_ == 0; });
+      }
+    }
+    boost::optional<completion> c(std::move(done_.front()));
+    done_.pop_front();
+    return c;
+  }
+
+  Executor &executor_;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::deque<completion> done_;
+  std::size_t pending_;
+  // Set when the consumer ignores the remaining results
+  std::atomic<bool> cancelled_;
+};
+}
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef COMMUNICATION_RUNNER_HPP
+#define COMMUNICATION_RUNNER_HPP
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../Affinity.hpp"
+#include "../Executor.hpp"
+#include "noncopyable.hpp"
+
+namespace detail {
+// Step of a worker. Processes the next piece of work and returns true, or
+// returns false if there is none. If wait is set, the step waits for work and
+// returns false only when the worker stops.
+using step_function = std::function<bool(bool wait)>;
+
+// Runs the step in a loop on its own thread
+class thread_runner : noncopyable {
+ public:
+  thread_runner() : thread_id_(0), placement_changed_(false) {}
+
+  ~thread_runner() { stop(); }
+
+  void start(step_function step) {
+    thread_ = std::thread([this, step]() {
+      thread_id_ = affinity::current_thread_id();
+      do {
+        apply_placement_();
+      } while (step(true));
+    });
+  }
+
+  // Placement of the thread. Thread is pinned at once and places its memory
+  // before its next step.
+  void set_placement(Placement placement) {
+    affinity::pin(thread_, placement);
+    std::lock_guard<std::mutex> lk(mtx_);
+    placement_ = std::move(placement);
+    placement_changed_ = true;
+  }
+
+  std::vector<ThreadPlacement> topology(std::string name) const {
+    if (thread_id_ == 0) {
+      return {};
+    }
+    return {affinity::describe(std::move(name), thread_id_)};
+  }
+
+  // Work is available. The thread waits for work by itself.
+  void notify() noexcept {}
+
+  // Wait until the step returns false
+  void stop() {
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+ private:
+  void apply_placement_() {
+    if (!placement_changed_) {
+      return;
+    }
+    Placement placement;
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      placement = placement_;
+      placement_changed_ = false;
+    }
+    affinity::apply(placement);
+  }
+
+  std::thread thread_;
+  std::atomic<long> thread_id_;
+  std::mutex mtx_;
+  Placement placement_;
+  std::atomic<bool> placement_changed_;
+};
+
+// Runs the step as a task on the executor when there is work. At most one task
+// is scheduled at a time, so that the steps never run concurrently and
+// process the work in order. The task yields the thread to the other tasks
+// after a number of steps.
+class scheduled_runner : noncopyable {
+ public:
+  explicit scheduled_runner(
+      std::shared_ptr<Executor> executor = Executor::shared())
+      : executor_(std::move(executor)), requests_(0), stopped_(false) {}
+
+  ~scheduled_runner() { stop(); }
+
+  void start(step_function step) { step_ = std::move(step); }
+
+  // Steps run on the threads of the executor, which are not placed per
+  // worker
+  void set_placement(Placement) noexcept {}
+
+  std::vector<ThreadPlacement> topology(std::string) const { return {}; }
+
+  // Work is available. Schedules the step, unless it is scheduled already.
+  void notify() {
+    if (requests_.fetch_add(1) == 0) {
+      submit_();
+    }
+  }
+
+  // Wait for the scheduled task and run the step on the calling thread until
+  // it returns false. Work is no longer scheduled afterwards. Must not be
+  // called from the executor's threads.
+  void stop() {
+    if (stopped_ || !step_) {
+      return;
+    }
+    stopped_ = true;
+    {
+      std::unique_lock<std::mutex> lk(mtx_);
+      // Pending request keeps notify from scheduling the step
+      cv_.wait(lk, [this]() {
+        std::size_t idle = 0;
+        return requests_.compare_exchange_strong(idle, 1);
+      });
+    }
+    while (step_(true)) {
+    }
+  }
+
+ private:
+  // Steps executed by a single task
+  static constexpr std::size_t budget = 16;
+
+  void submit_() {
+    executor_->submit([this]() { run_(); });
+  }
+
+  void run_() {
+    auto requests = requests_.load();
+    for (std::size_t i = 0; i < budget; ++i) {
+      if (step_(false)) {
+        continue;
+      }
+      // Stop, unless there was a notification since the start of the task
+      std::lock_guard<std::mutex> lk(mtx_);
+      if (requests_.compare_exchange_strong(requests, 0)) {
+        cv_.notify_all();
+        return;
+      }
+    }
+    submit_();
+  }
+
+  std::shared_ptr<Executor> executor_;
+  step_function step_;
+  // Number of notifications since the task was scheduled, 0 if it is not
+  std::atomic<std::size_t> requests_;
+  bool stopped_;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+};
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef COMMUNICATION_SERVICE_RECORD_HPP
+#define COMMUNICATION_SERVICE_RECORD_HPP
+
+#pragma once
+
+#include <memory>
+
+namespace detail {
+// Unique id of a type. Address of the static member is unique for each type,
+// which makes the comparison of the ids a single pointer comparison.
+using type_id_t = void const *;
+
+template <typename T>
+struct type_id_tag {
+  static const char id;
+};
+template <typename T>
+const char type_id_tag<T>::id = 0;
+
+template <typename T>
+constexpr type_id_t type_id() noexcept {
+  return &type_id_tag<T>::id;
+}
+
+// Type-erased service. Record stores the service and the id of its type.
+// Copying a record shares the stored service.
+class service_record {
+ public:
+  // Empty record, which does not store any service
+  service_record() : type_(nullptr) {}
+
+  template <typename ServiceT>
+  explicit service_record(ServiceT const &service)
+      : type_(type_id<ServiceT>()),
+        service_(std::make_shared<ServiceT const>(service)) {}
+
+  // Return the stored service or nullptr, if the service is not of type
+  // ServiceT.
+  template <typename ServiceT>
+  ServiceT const *get() const noexcept {
+    return type_ == type_id<ServiceT>()
+               ? static_cast<ServiceT const *>(service_.get())
+               : nullptr;
+  }
+
+  // Type id of the stored service or nullptr, if the record is empty
+  type_id_t type() const noexcept { return type_; }
+
+ private:
+  type_id_t type_;
+  std::shared_ptr<void const> service_;
+};
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef COMMUNICATION_SNAPSHOT_HPP
+#define COMMUNICATION_SNAPSHOT_HPP
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "epoch.hpp"
+#include "noncopyable.hpp"
+
+namespace detail {
+// Immutable value which is replaced as a whole. Readers take the current
+// snapshot without a lock and keep it alive for as long as they use it.
+// Version counts the stores, so that readers can check for a new snapshot
+// with a single load.
+template <typename T>
+class snapshot : noncopyable {
+ public:
+  using pointer = std::shared_ptr<T const>;
+
+  explicit snapshot(pointer value = std::make_shared<T const>())
+      : value_(std::make_unique<pointer>(std::move(value))), version_(0) {}
+
+  pointer load() const {
+    epoch_guard guard;
+    return *value_.load();
+  }
+
+  // Publish the new snapshot. Readers which see the new version see the new
+  // snapshot as well.
+  void store(pointer value) {
+    value_.store(std::make_unique<pointer>(std::move(value)));
+    version_.fetch_add(1, std::memory_order_release);
+  }
+
+  // Number of stores
+  std::uint64_t version() const noexcept {
+    return version_.load(std::memory_order_acquire);
+  }
+
+ private:
+  rcu_ptr<pointer> value_;
+  std::atomic<std::uint64_t> version_;
+};
+}
+
+#endif
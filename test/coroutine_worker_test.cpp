@@ -0,0 +1,223 @@
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+// Coroutine workers need C++20, the tests are empty otherwise
+#if defined(__cpp_impl_coroutine)
+
+#include <communication/Workers.hpp>
+#include <communication/ServiceBroker.hpp>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Waits for the timer, as if it waited for a remote service
+class SleepingWorker : public WorkerCoroutine<int, int> {
+ public:
+  using WorkerCoroutine<int, int>::WorkerCoroutine;
+  ~SleepingWorker() { stop(); }
+
+  std::atomic<int> running{0};
+  std::atomic<int> max_running{0};
+
+ protected:
+  task_type run(int const &arg) override {
+    auto now = ++running;
+    auto max = max_running.load();
+    while (now > max && !max_running.compare_exchange_weak(max, now)) {
+    }
+    co_await sleep_for(std::chrono::milliseconds(arg % 2 == 0 ? 20 : 1));
+    --running;
+    co_return arg;
+  }
+};
+
+// Reads a line from the pipe and asks another service to transform it
+class PipeWorker : public WorkerCoroutine<int, std::string> {
+ public:
+  using WorkerCoroutine<int, std::string>::WorkerCoroutine;
+  ~PipeWorker() { stop(); }
+
+ protected:
+  task_type run(int const &fd) override {
+    co_await readable(fd);
+    auto line = co_await offload([fd]() {
+      char buffer[64];
+      auto size = ::read(fd, buffer, sizeof(buffer));
+      return std::string(buffer, std::max<ssize_t>(size, 0));
+    });
+    auto results = co_await call<std::string>("upper", line);
+    co_return results.at(0);
+  }
+};
+
+// Misses the call of stop() in its destructor
+class UnstoppedWorker : public WorkerCoroutine<int, int> {
+ public:
+  using WorkerCoroutine<int, int>::WorkerCoroutine;
+
+ protected:
+  task_type run(int const &arg) override {
+    co_await sleep_for(std::chrono::seconds(10));
+    co_return arg;
+  }
+};
+
+template <typename T>
+void wait_for(std::mutex &mtx, std::vector<T> const &results,
+              std::size_t count) {
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      if (results.size() == count) {
+        return;
+      }
+    }
+    std::this_thread::yield();
+  }
+}
+
+TEST(CoroutineWorkerTest, Process) {
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("provider.result");
+  broker->add_service(input);
+  const std::vector<std::string> inputs{"provider"};
+  SleepingWorker worker("worker", broker, inputs);
+
+  std::vector<int> results;
+  std::vector<std::size_t> sequence;
+  std::mutex mtx;
+  broker->register_callback("worker.result", [&](int result) {
+    std::lock_guard<std::mutex> lk(mtx);
+    results.push_back(result);
+  });
+  broker->register_callback("worker.sequenced_result",
+                            [&](Sequenced<int> result) {
+                              std::lock_guard<std::mutex> lk(mtx);
+                              ASSERT_EQ(result.value,
+                                        static_cast<int>(result.sequence));
+                              sequence.push_back(result.sequence);
+                            });
+  for (int i = 0; i < 20; ++i) {
+    input(i);
+  }
+  wait_for(mtx, results, 20);
+
+  // Tasks wait concurrently and the short ones complete first
+  ASSERT_GT(worker.max_running, 1);
+  ASSERT_EQ(1, results.front() % 2);
+  std::sort(results.begin(), results.end());
+  std::sort(sequence.begin(), sequence.end());
+  for (int i = 0; i < 20; ++i) {
+    ASSERT_EQ(i, results[i]);
+    ASSERT_EQ(static_cast<std::size_t>(i), sequence[i]);
+  }
+  auto metrics = worker.latency_metrics();
+  ASSERT_EQ(20u, metrics.execution.count);
+  ASSERT_GE(metrics.execution.max, 20000000u);
+}
+
+TEST(CoroutineWorkerTest, MaxInFlight) {
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("provider.result");
+  broker->add_service(input);
+  const std::vector<std::string> inputs{"provider"};
+  SleepingWorker worker("worker", broker, inputs);
+  worker.set_max_in_flight(2);
+
+  std::vector<int> results;
+  std::mutex mtx;
+  broker->register_callback("worker.result", [&](int result) {
+    std::lock_guard<std::mutex> lk(mtx);
+    results.push_back(result);
+  });
+  for (int i = 0; i < 10; ++i) {
+    input(i);
+  }
+  wait_for(mtx, results, 10);
+
+  ASSERT_EQ(2, worker.max_running);
+  ASSERT_EQ(0u, worker.in_flight());
+}
+
+TEST(CoroutineWorkerTest, StopWaitsForTasksInFlight) {
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("provider.result");
+  broker->add_service(input);
+  const std::vector<std::string> inputs{"provider"};
+  std::atomic<int> results{0};
+  {
+    SleepingWorker worker("worker", broker, inputs);
+    worker.set_max_in_flight(2);
+    broker->register_callback("worker.result", [&](int) { ++results; });
+    for (int i = 0; i < 10; ++i) {
+      input(2 * i);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+
+  // Tasks in flight complete, the queued ones are discarded
+  ASSERT_GE(results, 2);
+  ASSERT_LT(results, 10);
+}
+
+// Tasks in flight would resume into the destroyed derived worker
+#ifndef NDEBUG
+void destroy_in_flight() {
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("provider.result");
+  broker->add_service(input);
+  const std::vector<std::string> inputs{"provider"};
+  UnstoppedWorker worker("worker", broker, inputs);
+  input(1);
+  while (worker.in_flight() != 1) {
+    std::this_thread::yield();
+  }
+}
+
+TEST(CoroutineWorkerTest, DestroyedWithoutStop) {
+  ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+  ASSERT_DEATH(destroy_in_flight(), "destroyed without stop");
+}
+#endif
+
+TEST(CoroutineWorkerTest, ReadableAndCall) {
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("provider.result");
+  Service<std::string, std::string> upper("upper");
+  broker->add_service(input);
+  broker->add_service(upper);
+  broker->register_callback("upper", [](std::string value) {
+    std::transform(value.begin(), value.end(), value.begin(), ::toupper);
+    return value;
+  });
+  const std::vector<std::string> inputs{"provider"};
+  PipeWorker worker("worker", broker, inputs);
+
+  std::vector<std::string> results;
+  std::mutex mtx;
+  broker->register_callback("worker.result", [&](std::string result) {
+    std::lock_guard<std::mutex> lk(mtx);
+    results.push_back(result);
+  });
+  int fds[2];
+  ASSERT_EQ(0, ::pipe(fds));
+  input(fds[0]);
+
+  // Task waits for the data without holding a thread
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ASSERT_EQ(1u, worker.in_flight());
+  ASSERT_EQ(5, ::write(fds[1], "hello", 5));
+  wait_for(mtx, results, 1);
+  ASSERT_EQ("HELLO", results[0]);
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+#endif
@@ -9,6 +9,10 @@
 #include <chrono>
 #include <type_traits>
 #include <string>
+#include <algorithm>
+#include <set>
+#include <sstream>
+#include <memory>
 
 class DataProvider : public WorkerBase {
   using result_type = std::string;
@@ -47,6 +51,8 @@ class TrivialMultithreaded
     : public WorkerMultiThreaded<std::string, std::string, TestContext> {
   using Base = WorkerMultiThreaded<std::string, std::string, TestContext>;
   using Base::Base;
+public:
+  ~TrivialMultithreaded() { stop(); }
 protected:
 
   void preprocess(std::string const &arg) override { schedule(arg); }
@@ -69,9 +75,454 @@ TEST(MultithreadedWorkerTest, Process) {
   provider.start();
 
   provider.working_thread_.join();
-  while (result.size() != 100u) {
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      if (result.size() == 100u) {
+        break;
+      }
+    }
     std::this_thread::sleep_for(std::chrono::microseconds(50));
   }
 
+  std::lock_guard<std::mutex> lk(mtx);
   ASSERT_EQ(100u, result.size());
 }
+
+TEST(MultithreadedWorkerTest, ExecutorCount) {
+  auto broker = std::make_shared<ServiceBroker>();
+  ExecutorOptions options;
+  options.executors = 2;
+  TrivialMultithreaded worker("worker", broker, {}, options);
+  ASSERT_EQ(2u, worker.executors());
+
+  options.executors = 5;
+  worker.set_executor_options(options);
+  ASSERT_EQ(5u, worker.executors());
+  options.executors = 1;
+  worker.set_executor_options(options);
+  ASSERT_EQ(1u, worker.executors());
+}
+
+struct SlowContext : ContextBase<int, int> {
+  int run(int const &arg) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    return arg;
+  }
+};
+
+TEST(ContextExecutorTest, Adaptive) {
+  ExecutorOptions options;
+  options.adaptive = true;
+  options.executors = 1;
+  options.min_executors = 1;
+  options.max_executors = 4;
+  options.target_delay = std::chrono::milliseconds(1);
+  options.idle_timeout = std::chrono::milliseconds(20);
+  options.cooldown = std::chrono::milliseconds(0);
+  ContextExecutor<SlowContext> executors(options);
+
+  // Backlog adds executors up to the maximum
+  for (int i = 0; i < 8; ++i) {
+    executors.schedule_task(i);
+  }
+  executors.result_queue.pull_front().value.get();
+  // Wait until the execution time is measured
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  for (int i = 0; i < 64; ++i) {
+    executors.schedule_task(i);
+  }
+  ASSERT_EQ(4u, executors.size());
+
+  // Results are in the order of scheduling
+  for (int i = 1; i < 8; ++i) {
+    ASSERT_EQ(i, executors.result_queue.pull_front().value.get());
+  }
+  for (int i = 0; i < 64; ++i) {
+    ASSERT_EQ(i, executors.result_queue.pull_front().value.get());
+  }
+
+  // Idle executors are removed down to the minimum
+  while (executors.size() != 1u) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  ASSERT_EQ(1u, executors.contexts().size());
+}
+
+struct SkewedContext : ContextBase<int, int> {
+  int run(int const &arg) {
+    if (arg == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return arg;
+  }
+};
+
+class SkewedWorker : public WorkerMultiThreaded<int, int, SkewedContext> {
+  using Base = WorkerMultiThreaded<int, int, SkewedContext>;
+
+ public:
+  using Base::Base;
+
+ protected:
+  void preprocess(int const &arg) override { schedule(arg); }
+  int postprocess(int &&arg) override { return arg; }
+};
+
+TEST(MultithreadedWorkerTest, Unordered) {
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("provider.result");
+  broker->add_service(input);
+  ExecutorOptions options;
+  options.executors = 2;
+  options.ordered = false;
+  SkewedWorker worker("worker", broker, {"provider"}, options);
+
+  std::vector<int> results;
+  std::vector<std::size_t> sequence;
+  std::mutex mtx;
+  broker->register_callback("worker.result", [&](int result) {
+    std::lock_guard<std::mutex> lk(mtx);
+    results.push_back(result);
+  });
+  broker->register_callback("worker.sequenced_result",
+                            [&](Sequenced<int> result) {
+                              std::lock_guard<std::mutex> lk(mtx);
+                              ASSERT_EQ(result.value,
+                                        static_cast<int>(result.sequence));
+                              sequence.push_back(result.sequence);
+                            });
+  for (int i = 0; i < 10; ++i) {
+    input(i);
+  }
+  while (true) {
+    std::lock_guard<std::mutex> lk(mtx);
+    if (results.size() == 10u) {
+      break;
+    }
+  }
+
+  // Slow task does not hold back the others
+  ASSERT_EQ(0, results.back());
+  std::sort(sequence.begin(), sequence.end());
+  ASSERT_EQ((std::vector<std::size_t>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9}),
+            sequence);
+}
+
+// Ordered results of fast tasks wait for the slow task before them
+TEST(MultithreadedWorkerTest, LatencyMetrics) {
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("provider.result");
+  broker->add_service(input);
+  ExecutorOptions options;
+  options.executors = 2;
+  SkewedWorker worker("worker", broker, {"provider"}, options);
+
+  std::atomic<int> results{0};
+  broker->register_callback("worker.result", [&](int) { ++results; });
+  for (int i = 0; i < 10; ++i) {
+    input(i);
+  }
+  while (results != 10) {
+    std::this_thread::yield();
+  }
+
+  auto metrics = worker.latency_metrics();
+  ASSERT_EQ(10u, metrics.queue_wait.count);
+  ASSERT_EQ(10u, metrics.execution.count);
+  ASSERT_EQ(10u, metrics.end_to_end.count);
+  const std::uint64_t slow = 50000000;
+  ASSERT_LT(metrics.execution.percentile(0.5), slow);
+  ASSERT_GE(metrics.execution.max, slow);
+  ASSERT_GE(metrics.end_to_end.percentile(0.5), slow);
+}
+
+struct SinkWorker : WorkerSingleThreaded<int, int> {
+  using WorkerSingleThreaded<int, int>::WorkerSingleThreaded;
+
+ protected:
+  int run(int const &arg) override { return arg; }
+};
+
+// Spans of a traced request through a multi-threaded and a single-threaded
+// worker
+TEST(MultithreadedWorkerTest, Tracing) {
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("provider.result");
+  broker->add_service(input);
+  // Names of the workers are interned by their first traced request only
+  auto const &names = tracing::detail::get_registry().names;
+  auto const interned = names.size();
+  // Sink connects to the results of the worker and outlives it, so that the
+  // worker stops before the queue of the sink is destroyed
+  std::unique_ptr<SinkWorker> sink;
+  SkewedWorker worker("worker", broker, {"provider"});
+  std::vector<std::string> const sink_inputs{"worker"};
+  sink.reset(new SinkWorker("sink", broker, sink_inputs));
+  std::atomic<int> results{0};
+  broker->register_callback("sink.result", [&](int) { ++results; });
+  ASSERT_EQ(interned, names.size());
+
+  tracing::enable();
+  auto trace = tracing::start_trace();
+  {
+    tracing::scoped_context context(trace);
+    input(1);
+  }
+  // Request which is not traced records no spans
+  input(2);
+  tracing::enable(false);
+  ASSERT_FALSE(tracing::start_trace());
+  while (results != 2) {
+    std::this_thread::yield();
+  }
+
+  // Emit spans end after the results are signalled
+  std::multiset<std::string> spans;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (spans.size() < 10u && std::chrono::steady_clock::now() < deadline) {
+    for (auto const &span : tracing::collect()) {
+      ASSERT_EQ(trace.id, span.trace_id);
+      ASSERT_LE(span.begin, span.end);
+      spans.insert(std::string(span.worker) + "." + span.name);
+    }
+  }
+  ASSERT_EQ((std::multiset<std::string>{
+                "sink.dequeue", "sink.emit", "sink.enqueue", "sink.execute",
+                "worker.dequeue", "worker.emit", "worker.enqueue",
+                "worker.execute", "worker.postprocess", "worker.preprocess"}),
+            spans);
+  ASSERT_TRUE(tracing::collect().empty());
+
+  std::vector<TraceSpan> one{{trace.id, "execute", "worker",
+                              std::chrono::steady_clock::time_point(),
+                              std::chrono::steady_clock::time_point() +
+                                  std::chrono::microseconds(5),
+                              42}};
+  std::ostringstream json;
+  tracing::write_chrome_trace(json, one);
+  ASSERT_NE(std::string::npos,
+            json.str().find("{\"name\":\"execute\",\"cat\":\"worker\","
+                            "\"ph\":\"X\",\"ts\":0.000,\"dur\":5.000,"
+                            "\"pid\":1,\"tid\":42"));
+}
+
+TEST(MultithreadedWorkerTest, Backpressure) {
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("provider.result");
+  broker->add_service(input);
+  ExecutorOptions options;
+  options.executors = 2;
+  SkewedWorker worker("worker", broker, {"provider"}, options);
+  TaskQueueOptions<int> queue_options;
+  queue_options.capacity = 4;
+  queue_options.backpressure = Backpressure::DropOldest;
+  worker.set_queue_options(queue_options);
+
+  std::atomic<std::size_t> processed{0};
+  broker->register_callback("worker.result",
+                            [&processed](int) { ++processed; });
+  // Slow tasks occupy both executors
+  input(0);
+  input(0);
+  std::size_t max_pending = 0;
+  for (int i = 1; i <= 198; ++i) {
+    input(i);
+    max_pending = std::max(max_pending, worker.pending());
+  }
+  while (processed + worker.dropped() != 200u) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_LE(max_pending, 4u);
+  ASSERT_GT(worker.dropped(), 0u);
+}
+
+class ScheduledWorker
+    : public WorkerMultiThreaded<int, int, SkewedContext, SharedScheduler> {
+  using Base = WorkerMultiThreaded<int, int, SkewedContext, SharedScheduler>;
+
+ public:
+  using Base::Base;
+
+ protected:
+  void preprocess(int const &arg) override { schedule(arg); }
+  int postprocess(int &&arg) override { return arg; }
+};
+
+TEST(MultithreadedWorkerTest, SharedScheduler) {
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("provider.result");
+  broker->add_service(input);
+  ExecutorOptions options;
+  options.executors = 2;
+  ScheduledWorker worker("worker", broker, {"provider"}, options);
+  ASSERT_EQ(2u, worker.executors());
+
+  std::vector<int> results;
+  std::mutex mtx;
+  broker->register_callback("worker.result", [&](int result) {
+    std::lock_guard<std::mutex> lk(mtx);
+    results.push_back(result);
+  });
+  for (int i = 0; i < 10; ++i) {
+    input(i);
+  }
+  while (true) {
+    std::lock_guard<std::mutex> lk(mtx);
+    if (results.size() == 10u) {
+      break;
+    }
+  }
+
+  // Results are in the order of the tasks
+  ASSERT_EQ((std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9}), results);
+
+  options.executors = 3;
+  worker.set_executor_options(options);
+  ASSERT_EQ(3u, worker.executors());
+}
+
+TEST(MultithreadedWorkerTest, Placement) {
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("provider.result");
+  broker->add_service(input);
+  ExecutorOptions options;
+  options.executors = 2;
+  auto cpu = affinity::describe("test", affinity::current_thread_id()).cpus[0];
+  options.placement.cpus = {cpu};
+  SkewedWorker worker("worker", broker, {"provider"}, options);
+  worker.set_placement(options.placement);
+
+  std::atomic<int> results{0};
+  broker->register_callback("worker.result", [&results](int) { ++results; });
+  for (int i = 1; i <= 4; ++i) {
+    input(i);
+  }
+  while (results != 4) {
+    std::this_thread::yield();
+  }
+
+  auto topology = worker.topology();
+  ASSERT_EQ(4u, topology.size());
+  ASSERT_EQ("worker.preprocess", topology[0].name);
+  ASSERT_EQ("worker.postprocess", topology[1].name);
+  ASSERT_EQ("worker.executor.0", topology[2].name);
+  for (auto const &thread : topology) {
+    ASSERT_EQ(std::vector<unsigned>{cpu}, thread.cpus);
+  }
+}
+
+// Drains the scheduled tasks in its destructor, while postprocess is still
+// there
+class DrainingWorker : public WorkerMultiThreaded<int, int, SlowContext> {
+  using Base = WorkerMultiThreaded<int, int, SlowContext>;
+
+ public:
+  using Base::Base;
+  ~DrainingWorker() { stop(); }
+
+ protected:
+  void preprocess(int const &arg) override { schedule(arg); }
+  int postprocess(int &&arg) override { return arg; }
+};
+
+TEST(MultithreadedWorkerTest, StopSignalsPendingResults) {
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("provider.result");
+  broker->add_service(input);
+  ExecutorOptions options;
+  options.executors = 2;
+  std::atomic<int> results{0};
+  {
+    DrainingWorker worker("worker", broker, {"provider"}, options);
+    broker->register_callback("worker.result", [&](int) { ++results; });
+    for (int i = 0; i < 32; ++i) {
+      input(i);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    ASSERT_LT(results, 32);
+  }
+  ASSERT_EQ(32, results);
+}
+
+// Pre-processing and post-processing share the state of the worker without a
+// lock
+class SharedStateWorker : public WorkerMultiThreaded<int, int, SlowContext> {
+  using Base = WorkerMultiThreaded<int, int, SlowContext>;
+
+ public:
+  using Base::Base;
+  ~SharedStateWorker() { stop(); }
+
+  std::atomic<bool> overlapped{false};
+  int state = 0;
+
+ protected:
+  void preprocess(int const &arg) override {
+    enter_();
+    ++state;
+    schedule(arg);
+    leave_();
+  }
+  int postprocess(int &&arg) override {
+    enter_();
+    ++state;
+    leave_();
+    return arg;
+  }
+
+ private:
+  void enter_() {
+    if (++inside_ > 1) {
+      overlapped = true;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+  void leave_() { --inside_; }
+
+  std::atomic<int> inside_{0};
+};
+
+TEST(MultithreadedWorkerTest, ExclusivePrePostprocess) {
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("provider.result");
+  broker->add_service(input);
+  ExecutorOptions options;
+  options.executors = 4;
+  SharedStateWorker worker("worker", broker, {"provider"}, options);
+  std::atomic<int> results{0};
+  broker->register_callback("worker.result", [&](int) { ++results; });
+  for (int i = 0; i < 64; ++i) {
+    input(i);
+  }
+  while (results != 64) {
+    std::this_thread::yield();
+  }
+  ASSERT_FALSE(worker.overlapped);
+  ASSERT_EQ(128, worker.state);
+}
+
+// Worker destroyed without stop() reports the results it discards
+TEST(MultithreadedWorkerTest, DestroyedWithoutStop) {
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("provider.result");
+  broker->add_service(input);
+  std::vector<Log> logs;
+  {
+    ExecutorOptions options;
+    options.executors = 1;
+    SkewedWorker worker("worker", broker, {"provider"}, options);
+    broker->register_callback("log.worker",
+                              [&logs](Log log) { logs.push_back(log); });
+    // Ordered results wait for the slow first task
+    for (int i = 0; i < 10; ++i) {
+      input(i);
+    }
+    while (worker.pending() != 10) {
+      std::this_thread::yield();
+    }
+  }
+  ASSERT_EQ(1u, logs.size());
+  ASSERT_EQ(Log::Severity::Error, logs[0].severity);
+  ASSERT_EQ(0u, logs[0].message.find("10 tasks discarded by worker"));
+}
@@ -1,8 +1,13 @@
 #include "gtest/gtest.h"
 #include "gmock/gmock.h"
 #include <communication/ServiceBroker.hpp>
+#include <communication/ConcurrentServiceBroker.hpp>
 
+#include <boost/any.hpp>
+
+#include <atomic>
 #include <iostream>
+#include <numeric>
 #include <functional>
 #include <thread>
 #include <chrono>
@@ -16,6 +21,29 @@ TEST(SanitizeName, Sanitize) {
   ASSERT_EQ("a.b.c", detail::sanitize_name("a.b.c"));
 }
 
+TEST(SanitizeName, IsSanitized) {
+  ASSERT_TRUE(detail::is_sanitized(""));
+  ASSERT_TRUE(detail::is_sanitized("a.b"));
+  ASSERT_FALSE(detail::is_sanitized(".a"));
+  ASSERT_FALSE(detail::is_sanitized("a."));
+  ASSERT_FALSE(detail::is_sanitized("a..b"));
+}
+
+TEST(SymbolTableTest, Intern) {
+  SymbolTable symbols;
+  auto a = symbols.intern("a");
+  auto b = symbols.intern(std::string("b"));
+  ASSERT_NE(a, b);
+  ASSERT_EQ(a, symbols.intern(boost::string_view("ab", 1)));
+  ASSERT_EQ("b", symbols.name(b));
+  ASSERT_EQ(b, *symbols.find("b"));
+  ASSERT_FALSE(symbols.find("c"));
+
+  auto copy = symbols;
+  ASSERT_EQ(a, *copy.find("a"));
+  ASSERT_EQ(2u, copy.size());
+}
+
 TEST(ServiceDirectoryTest, AddService) {
   ServiceDirectory service_directory;
   ASSERT_THROW(service_directory.add_service(""), broker_error);
@@ -61,6 +89,76 @@ TEST(ServiceDirectoryTest, ListServices) {
   ASSERT_EQ(2u, service_directory.list_services().size());
 }
 
+TEST(ServiceDirectoryTest, ListServicesOrder) {
+  ServiceDirectory service_directory;
+  service_directory.add_service("b.a");
+  service_directory.add_service("a-x");
+  service_directory.add_service("a.c.d");
+  service_directory.add_service("a.b");
+
+  std::vector<std::string> expected = {"a.b", "a.c.d", "a-x", "b.a"};
+  ASSERT_EQ(expected, service_directory.list_services());
+  service_directory.remove_service("a.c");
+  expected = {"a.b", "a-x", "b.a"};
+  ASSERT_EQ(expected, service_directory.list_services());
+  expected = {"a.b"};
+  ASSERT_EQ(expected, service_directory.list_services(".a."));
+  ASSERT_EQ(expected, service_directory.list_services("a.b"));
+  ASSERT_TRUE(service_directory.list_services("a.b.c").empty());
+}
+
+TEST(ServiceDirectoryTest, NodeType) {
+  ServiceDirectory service_directory;
+  service_directory.add_service("a.b.c");
+  ASSERT_EQ(ServiceDirectory::NodeType::Group,
+            *service_directory.node_type("a"));
+  ASSERT_EQ(ServiceDirectory::NodeType::Group,
+            *service_directory.node_type("a.b"));
+  ASSERT_EQ(ServiceDirectory::NodeType::Service,
+            *service_directory.node_type("a.b.c"));
+  ASSERT_FALSE(service_directory.node_type("a.c"));
+  ASSERT_THROW(service_directory.add_service("a.b"), broker_error);
+  ASSERT_THROW(service_directory.add_service("a.b.c.d"), broker_error);
+
+  service_directory.add_service("a.d");
+  service_directory.remove_service("a.b");
+  ASSERT_FALSE(service_directory.node_type("a.b"));
+  service_directory.remove_service("a");
+  ASSERT_FALSE(service_directory.node_type("a.d"));
+
+  // Groups left without services are removed
+  service_directory.add_service("a.b.c");
+  service_directory.remove_service("a.b.c");
+  ASSERT_FALSE(service_directory.node_type("a.b"));
+  ASSERT_FALSE(service_directory.node_type("a"));
+  ASSERT_NO_THROW(service_directory.add_service("a"));
+}
+
+TEST(ServiceDirectoryTest, Compaction) {
+  ServiceDirectory service_directory;
+  service_directory.add_service("static.service");
+  auto symbol = service_directory.add_service("worker.0.input");
+  service_directory.remove_service("worker.0");
+  ASSERT_EQ(symbol, service_directory.add_service("worker.0.input"));
+  service_directory.remove_service("worker.0.input");
+
+  // Names of the removed services are released, so that the directory does
+  // not grow with the number of names ever used
+  for (int i = 1; i < 100000; ++i) {
+    auto name = "worker." + std::to_string(i) + ".input";
+    service_directory.add_service(name);
+    service_directory.remove_service(name);
+  }
+  ASSERT_GT(2000u, service_directory.capacity());
+  ASSERT_EQ(std::vector<std::string>{"static.service"},
+            service_directory.list_services());
+
+  // Released symbols do not refer to the new names with the same id
+  ASSERT_FALSE(service_directory.find(symbol));
+  ASSERT_TRUE(service_directory.list_services(symbol).empty());
+  ASSERT_TRUE(service_directory.find("static.service"));
+}
+
 TEST(ServiceBrokerTest, Constructor) { ServiceBroker broker; }
 
 TEST(ServiceInfoTest, AnyCastExactTest) {
@@ -106,6 +204,20 @@ TEST(ServiceBrokerTest, GetService) {
   auto s2 = broker.get_service<void, std::string>("test");
 }
 
+TEST(ServiceBrokerTest, FindService) {
+  ServiceBroker broker;
+  Service<void, std::string> service = {"test"};
+  broker.add_service(service);
+  auto found = broker.find_service<void, std::string>("test");
+  ASSERT_NE(nullptr, found);
+  ASSERT_EQ(service.service, found->service);
+  ASSERT_EQ(nullptr, (broker.find_service<void, int>("test")));
+  ASSERT_EQ(nullptr, (broker.find_service<void, std::string>("other")));
+  ASSERT_THROW((broker.get_service<void, int>("test")), broker_error);
+  ASSERT_THROW(broker.call<void>("test", 1), broker_error);
+  ASSERT_THROW(broker.register_callback("test", [](int) {}), broker_error);
+}
+
 void test(std::string e) { std::cout << e << std::endl; }
 
 TEST(ServiceBrokerTest, RegisterCallback1) {
@@ -150,6 +262,26 @@ TEST(ServiceBrokerTest, CallbackOutOfScope) {
   service("test");
 }
 
+TEST(ServiceBrokerTest, EnvelopeService) {
+  ServiceBroker broker;
+  Service<void, Envelope<std::vector<int>>> service = {"test"};
+  broker.add_service(service);
+
+  // All the callbacks share the same payload
+  std::vector<Envelope<std::vector<int>>> received;
+  for (int i = 0; i < 3; ++i) {
+    broker.register_callback("test", [&received](
+        Envelope<std::vector<int>> payload) { received.push_back(payload); });
+  }
+  auto payload = make_envelope<std::vector<int>>(1024, 1);
+  auto data = payload.get();
+  service.emit(std::move(payload));
+  ASSERT_EQ(3u, received.size());
+  for (auto const &r : received) {
+    ASSERT_EQ(data, r.get());
+  }
+}
+
 TEST(ServiceBrokerTest, RegisterCallbackToMultipleServices) {
   ServiceBroker broker;
 
@@ -215,3 +347,364 @@ TEST(ServiceBrokerTest, CallWithReturn) {
 
   ASSERT_EQ("0123456789", broker.call_combine<std::string>("config", combiner));
 }
+
+TEST(ServiceBrokerTest, ResolveCall) {
+  ServiceBroker broker;
+
+  for (int i = 0; i < 10; ++i) {
+    Service<std::string, int> service("config.test" + std::to_string(i));
+    service.service->connect([i](int a) { return std::to_string(i + a); });
+    broker.add_service(service);
+  }
+
+  auto handle = broker.resolve<std::string, int>("config");
+  ASSERT_EQ(10u, handle.services().size());
+  ASSERT_EQ("1", handle(1).front());
+
+  auto combiner = [](std::vector<std::string> const &results) {
+    std::stringstream ss;
+    for (const auto &e : results) {
+      ss << e;
+    }
+    return ss.str();
+  };
+  ASSERT_EQ("0123456789", handle.combine(combiner, 0));
+
+  ASSERT_THROW((broker.resolve<std::string, int>("other")), broker_error);
+  ASSERT_THROW((broker.resolve<int, int>("config")), broker_error);
+}
+
+TEST(ServiceBrokerTest, ResolveRefresh) {
+  ServiceBroker broker;
+
+  int counter = 0;
+  Service<void> a("config.a");
+  a.service->connect([&counter]() { ++counter; });
+  broker.add_service(a);
+
+  auto handle = broker.resolve<void>("config");
+  handle();
+  ASSERT_EQ(1, counter);
+  ASSERT_TRUE(handle.valid());
+
+  Service<void> b("config.b");
+  b.service->connect([&counter]() { counter += 10; });
+  broker.add_service(b);
+  ASSERT_FALSE(handle.valid());
+  handle();
+  ASSERT_EQ(12, counter);
+  ASSERT_TRUE(handle.valid());
+
+  broker.remove_service("config.a");
+  handle();
+  ASSERT_EQ(22, counter);
+
+  broker.remove_service("config");
+  ASSERT_THROW(handle(), broker_error);
+}
+
+TEST(ConcurrentServiceBrokerTest, Call) {
+  ConcurrentServiceBroker broker;
+
+  for (int i = 0; i < 10; ++i) {
+    Service<int, int> service("config.test" + std::to_string(i));
+    service.service->connect([i](int a) { return i + a; });
+    broker.add_service(service);
+  }
+  ASSERT_THROW(broker.add_service(Service<int, int>("config.test0")),
+               broker_error);
+  ASSERT_EQ(10u, broker.list_services("config").size());
+  ASSERT_EQ(10u, broker.call<int>("config", 1).size());
+  ASSERT_EQ(2, broker.call<int>("config.test1", 1).front());
+  ASSERT_EQ(1, (broker.get_service<int, int>("config.test1")(0)));
+  ASSERT_EQ(10u, broker.call_parallel<int>("config", 1).size());
+  ASSERT_EQ(2, broker.call_async<int>("config.test1", 1).get().front());
+
+  auto handle = broker.resolve<int, int>("config");
+  ASSERT_EQ(10u, handle(0).size());
+  ASSERT_EQ(1u, broker.remove_service("config.test5"));
+  ASSERT_EQ(9u, handle(0).size());
+}
+
+TEST(ConcurrentServiceBrokerTest, CallWhileModifying) {
+  ConcurrentServiceBroker broker;
+  std::atomic<int> counter(0);
+  Service<void> service("group.service");
+  service.service->connect([&counter]() { ++counter; });
+  broker.add_service(service);
+
+  std::atomic<bool> done(false);
+  std::thread writer([&broker, &done]() {
+    for (int i = 0; i < 1000; ++i) {
+      auto name = "group.churn" + std::to_string(i % 10);
+      broker.add_service(Service<void>(name));
+      broker.remove_service(name);
+    }
+    done = true;
+  });
+
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; ++i) {
+    readers.emplace_back([&broker, &done]() {
+      do {
+        broker.call<void>("group.service");
+        broker.call<void>("group");
+      } while (!done);
+    });
+  }
+  writer.join();
+  for (auto &reader : readers) {
+    reader.join();
+  }
+  ASSERT_LT(0, counter.load());
+}
+
+TEST(ServiceBrokerTest, CallBySymbol) {
+  ServiceBroker broker;
+  int counter = 0;
+  Service<void, int> service("group.service");
+  service.service->connect([&counter](int a) { counter += a; });
+  broker.add_service(service);
+
+  auto group = broker.symbol("group");
+  ASSERT_TRUE(group);
+  ASSERT_EQ("group", broker.name(*group));
+  ASSERT_FALSE(broker.symbol("other"));
+
+  broker.call<void>(*group, 1);
+  broker.call<void>(boost::string_view("group.service"), 2);
+  ASSERT_EQ(3, counter);
+#if __cplusplus >= 201703L
+  broker.call<void>(std::string_view("group.service"), 0);
+  ASSERT_EQ(3, counter);
+#endif
+
+  // Symbol of a removed service is stale, the service added again is
+  // resolved anew
+  auto symbol = *broker.symbol("group.service");
+  broker.remove_service(symbol);
+  ASSERT_THROW(broker.call<void>(symbol, 1), broker_error);
+  broker.add_service(service);
+  symbol = *broker.symbol("group.service");
+  broker.call<void>(symbol, 1);
+  ASSERT_EQ(4, counter);
+}
+
+TEST(ServiceBrokerTest, CallParallel) {
+  ServiceBroker broker;
+  broker.set_executor(std::make_shared<Executor>(4));
+  for (int i = 0; i < 8; ++i) {
+    Service<int, int> service("group.service" + std::to_string(i));
+    service.service->connect([i](int a) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(8 - i));
+      return a + i;
+    });
+    broker.add_service(service);
+  }
+
+  // Results are in the same order as with a sequential call
+  ASSERT_EQ(broker.call<int>("group", 1),
+            broker.call_parallel<int>("group", 1));
+  ASSERT_EQ(28, broker.call_combine_parallel<int>(
+                    "group", [](std::vector<int> const &results) {
+                      return std::accumulate(results.begin(), results.end(), 0);
+                    },
+                    0));
+  ASSERT_EQ(36, broker.call_reduce_parallel<int>(
+                    "group", 0, [](int acc, int result) { return acc + result; },
+                    1));
+
+  ASSERT_THROW(broker.call_parallel<int>("other", 1), broker_error);
+  ASSERT_THROW(broker.call_parallel<void>("group", 1), broker_error);
+}
+
+TEST(ServiceBrokerTest, CallParallelException) {
+  ServiceBroker broker;
+  std::atomic<int> counter{0};
+  for (int i = 0; i < 4; ++i) {
+    Service<void> service("group.service" + std::to_string(i));
+    service.service->connect([i, &counter]() {
+      ++counter;
+      if (i == 2) {
+        throw std::runtime_error("failed");
+      }
+    });
+    broker.add_service(service);
+  }
+
+  // All services are called before the exception is rethrown
+  ASSERT_THROW(broker.call_parallel<void>("group"), std::runtime_error);
+  ASSERT_EQ(4, counter.load());
+}
+
+TEST(ServiceBrokerTest, CallAsync) {
+  ServiceBroker broker;
+  broker.set_executor(std::make_shared<Executor>(2));
+  for (int i = 0; i < 4; ++i) {
+    Service<int, int> service("group.service" + std::to_string(i));
+    service.service->connect([i](int a) { return a + i; });
+    broker.add_service(service);
+  }
+  std::atomic<int> counter{0};
+  Service<void, std::string> void_service("void");
+  void_service.service->connect(
+      [&counter](std::string const &s) { counter += s.size(); });
+  broker.add_service(void_service);
+
+  // Many requests may be outstanding at the same time
+  std::vector<std::future<std::vector<int>>> results;
+  for (int i = 0; i < 8; ++i) {
+    results.emplace_back(broker.call_async<int>("group", int{i}));
+  }
+  auto done = broker.call_async<void>("void", std::string("abc"));
+  for (int i = 0; i < 8; ++i) {
+    ASSERT_EQ(broker.call<int>("group", int{i}), results[i].get());
+  }
+  done.get();
+  ASSERT_EQ(3, counter.load());
+
+  // Errors in name or types are thrown immediately
+  ASSERT_THROW(broker.call_async<int>("other", 1), broker_error);
+  ASSERT_THROW(broker.call_async<void>("group", 1), broker_error);
+
+  // Exceptions of the services are stored in the future
+  Service<int> failing("failing");
+  failing.service->connect([]() -> int { throw std::runtime_error("failed"); });
+  broker.add_service(failing);
+  auto failed = broker.call_async<int>("failing");
+  ASSERT_THROW(failed.get(), std::runtime_error);
+
+  // Services can be called asynchronously also without the broker
+  auto service = broker.get_service<int, int>("group.service1");
+  ASSERT_EQ(3, service.async(*broker.executor(), 2).get());
+}
+
+TEST(ServiceBrokerTest, QueuedCallback) {
+  ServiceBroker broker;
+  Service<void, int> service("group.service");
+  broker.add_service(service);
+
+  // Slow callback does not hold up the service
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  std::vector<int> received;
+  std::mutex mtx;
+  DispatchPolicy policy;
+  policy.executor = std::make_shared<Executor>(1);
+  broker.register_callback("group",
+                           [released, &received, &mtx](int value) {
+                             released.wait();
+                             std::lock_guard<std::mutex> lk(mtx);
+                             received.push_back(value);
+                           },
+                           policy);
+  for (int i = 0; i < 100; ++i) {
+    service(i);
+  }
+  release.set_value();
+  while (true) {
+    std::lock_guard<std::mutex> lk(mtx);
+    if (received.size() == 100u) {
+      break;
+    }
+  }
+
+  // Messages are delivered in order
+  std::vector<int> expected(100);
+  std::iota(expected.begin(), expected.end(), 0);
+  ASSERT_EQ(expected, received);
+}
+
+TEST(ServiceBrokerTest, QueuedCallbackOverflow) {
+  auto executor = std::make_shared<Executor>(1);
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  std::vector<int> received;
+
+  // Executor is blocked, so that all messages stay in the mailboxes
+  executor->submit([released]() { released.wait(); });
+
+  {
+    DispatchPolicy policy;
+    policy.capacity = 2;
+    policy.executor = executor;
+    policy.overflow = Overflow::DropNewest;
+    auto newest =
+        queued([&received](int value) { received.push_back(value); }, policy);
+    policy.overflow = Overflow::DropOldest;
+    auto oldest = queued(
+        [&received](int value) { received.push_back(10 + value); }, policy);
+    for (int i = 0; i < 4; ++i) {
+      newest(i);
+      oldest(i);
+    }
+    ASSERT_EQ(2u, newest.mailbox()->pending());
+    ASSERT_EQ(2u, newest.mailbox()->dropped());
+    ASSERT_EQ(2u, oldest.mailbox()->dropped());
+    release.set_value();
+  }
+
+  // Executor delivers the pending messages before it is destroyed
+  executor.reset();
+  ASSERT_EQ((std::vector<int>{0, 1, 12, 13}), received);
+}
+
+TEST(ServiceBrokerTest, StreamingCombiner) {
+  ServiceBroker broker;
+  int calls = 0;
+  for (int i = 0; i < 6; ++i) {
+    Service<std::string, int> service("group.service" + std::to_string(i));
+    service.service->connect([i, &calls](int a) {
+      ++calls;
+      return i < a ? std::string() : std::to_string(i);
+    });
+    broker.add_service(service);
+  }
+
+  // Services after the first non-empty result are not called
+  auto non_empty = [](std::string const &s) { return !s.empty(); };
+  ASSERT_EQ(std::string("2"),
+            *broker.call_combine<std::string>(
+                "group", make_first_of<std::string>(non_empty), 2));
+  ASSERT_EQ(3, calls);
+  ASSERT_FALSE(broker.call_combine<std::string>(
+      "group", make_first_of<std::string>(non_empty), 6));
+
+  auto concat = make_fold<std::string>(
+      std::string(), [](std::string acc, std::string &&s) { return acc + s; });
+  ASSERT_EQ("012345", broker.call_combine<std::string>("group", concat, 0));
+  auto handle = broker.resolve<std::string, int>("group");
+  ASSERT_EQ("012345", handle.combine(concat, 0));
+  ASSERT_EQ(6u, broker.call_combine_parallel<std::string>("group", concat, 0)
+                    .size());
+  ASSERT_EQ(std::string("5"),
+            *broker.call_combine_parallel<std::string>(
+                "group", make_first_of<std::string>(non_empty), 5));
+
+  // Vector combiners work through the adapter
+  auto join = make_vector_combiner<std::string>(
+      [](std::vector<std::string> const &results) {
+        return results.front() + results.back();
+      });
+  ASSERT_EQ("05", broker.call_combine<std::string>("group", join, 0));
+}
+
+TEST(ServiceBrokerTest, ResolveAfterCompaction) {
+  ServiceBroker broker;
+  Service<int> service("group.service");
+  service.service->connect([]() { return 1; });
+  broker.add_service(service);
+  auto handle = broker.resolve<int>("group");
+
+  // Group is removed with its last service and its symbol is released
+  broker.remove_service("group.service");
+  for (int i = 0; i < 10000; ++i) {
+    Service<void> other("other" + std::to_string(i));
+    broker.add_service(other);
+    broker.remove_service(other.name);
+  }
+  ASSERT_THROW(handle(), broker_error);
+
+  broker.add_service(service);
+  ASSERT_EQ(std::vector<int>{1}, handle());
+}
@@ -0,0 +1,143 @@
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+#include <communication/Signal.hpp>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+TEST(SignalTest, Emit) {
+  Signal<int(int)> signal;
+  ASSERT_TRUE(signal.empty());
+  ASSERT_FALSE(signal(1));
+
+  std::vector<int> calls;
+  signal.connect([&calls](int a) {
+    calls.push_back(1);
+    return a + 1;
+  });
+  signal.connect([&calls](int a) {
+    calls.push_back(2);
+    return a + 2;
+  });
+  ASSERT_EQ(2u, signal.num_slots());
+
+  // Slots are called in the order of connection and the last result is
+  // returned
+  ASSERT_EQ(3, *signal(1));
+  ASSERT_EQ((std::vector<int>{1, 2}), calls);
+}
+
+TEST(SignalTest, Disconnect) {
+  Signal<void()> signal;
+  int counter = 0;
+  auto first = signal.connect([&counter]() { counter += 1; });
+  auto second = signal.connect([&counter]() { counter += 10; });
+
+  signal();
+  ASSERT_EQ(11, counter);
+  ASSERT_TRUE(first.connected());
+  first.disconnect();
+  ASSERT_FALSE(first.connected());
+  first.disconnect();
+  signal();
+  ASSERT_EQ(21, counter);
+  ASSERT_EQ(1u, signal.num_slots());
+
+  signal.disconnect_all_slots();
+  ASSERT_FALSE(second.connected());
+  signal();
+  ASSERT_EQ(21, counter);
+}
+
+TEST(SignalTest, ModifyDuringEmission) {
+  Signal<void()> signal;
+  int counter = 0;
+  SignalConnection first, second;
+
+  // First slot disconnects itself and the second slot and connects a new one
+  first = signal.connect([&]() {
+    first.disconnect();
+    second.disconnect();
+    signal.connect([&counter]() { counter += 100; });
+  });
+  second = signal.connect([&counter]() { counter += 10; });
+
+  // Second slot is not called anymore, the new slot only by the following
+  // emissions
+  signal();
+  ASSERT_EQ(0, counter);
+  signal();
+  ASSERT_EQ(100, counter);
+  ASSERT_EQ(1u, signal.num_slots());
+}
+
+TEST(SignalTest, ConnectionOutlivesSignal) {
+  SignalConnection connection;
+  {
+    Signal<void()> signal;
+    connection = signal.connect([]() {});
+    ASSERT_TRUE(connection.connected());
+  }
+  ASSERT_FALSE(connection.connected());
+  connection.disconnect();
+}
+
+TEST(SignalTest, EmitWhileConnecting) {
+  Signal<void()> signal;
+  std::atomic<int> counter{0};
+  std::atomic<bool> done{false};
+  signal.connect([&counter]() { ++counter; });
+
+  std::vector<std::thread> emitters;
+  for (int i = 0; i < 4; ++i) {
+    emitters.emplace_back([&]() {
+      while (!done) {
+        signal();
+      }
+    });
+  }
+  for (int i = 0; i < 1000; ++i) {
+    signal.connect([]() {}).disconnect();
+  }
+  // Emitters may not have started yet
+  while (counter == 0) {
+    std::this_thread::yield();
+  }
+  done = true;
+  for (auto &emitter : emitters) {
+    emitter.join();
+  }
+  ASSERT_EQ(1u, signal.num_slots());
+  ASSERT_LT(0, counter.load());
+}
+
+TEST(SignalTest, EmitMovesIntoLastSlot) {
+  Signal<void(std::vector<int>)> signal;
+  std::vector<int> first, last;
+  signal.connect([&first](std::vector<int> v) { first = std::move(v); });
+  signal.connect([&last](std::vector<int> v) { last = std::move(v); });
+
+  // The first slot receives a copy, the last one the original buffer
+  std::vector<int> payload(1024, 1);
+  auto data = payload.data();
+  signal.emit(std::move(payload));
+  ASSERT_EQ(1024u, first.size());
+  ASSERT_NE(data, first.data());
+  ASSERT_EQ(data, last.data());
+}
+
+TEST(SignalTest, DisconnectDuringEmissionReleasesSlot) {
+  Signal<void()> signal;
+  auto captured = std::make_shared<int>(0);
+  SignalConnection connection;
+  connection = signal.connect([&connection, captured]() {
+    connection.disconnect();
+  });
+
+  // Slot list in use by the emission is deleted once the emission ends,
+  // without a further modification of any signal
+  signal();
+  ASSERT_EQ(1, captured.use_count());
+}
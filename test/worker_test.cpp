@@ -8,6 +8,12 @@
 #include <thread>
 #include <chrono>
 #include <type_traits>
+#include <numeric>
+#include <set>
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <memory>
 
 using trivial_configuration_type = std::string;
 
@@ -20,10 +26,11 @@ struct MockBroker : public ServiceBroker {
                void(Service<void, trivial_configuration_type> service));
   MOCK_METHOD1(add_service_get_configuration,
                void(Service<trivial_configuration_type> service));
+  MOCK_METHOD1(add_service_metrics, void(Service<LatencyMetrics, bool> service));
   MOCK_METHOD1(register_callback_basic, void(std::string const &));
 
   template <typename Function>
-  std::vector<boost::signals2::connection>
+  std::vector<Connection>
   register_callback(std::string const &name, Function &&fn) {
     register_callback_basic(name);
     return {};
@@ -48,6 +55,9 @@ struct MockBroker : public ServiceBroker {
   void add_service(Service<trivial_configuration_type> service) {
     add_service_get_configuration(service);
   }
+  void add_service(Service<LatencyMetrics, bool> service) {
+    add_service_metrics(service);
+  }
 };
 
 // Here we need a real broker to connect the callbacks
@@ -69,8 +79,9 @@ TEST(WorkerTest, CheckRequiredServices) {
   EXPECT_CALL(*broker, add_service_error(testing::_)).Times(1);
   EXPECT_CALL(*broker, add_service_get_configuration(testing::_)).Times(1);
   EXPECT_CALL(*broker, add_service_set_configuration(testing::_)).Times(1);
-  EXPECT_CALL(*broker, remove_service(testing::_)).Times(4);
-  EXPECT_CALL(*broker, register_callback_basic(testing::_)).Times(2);
+  EXPECT_CALL(*broker, add_service_metrics(testing::_)).Times(1);
+  EXPECT_CALL(*broker, remove_service(testing::_)).Times(5);
+  EXPECT_CALL(*broker, register_callback_basic(testing::_)).Times(3);
   { TestWorker worker("worker", broker); }
 }
 
@@ -168,6 +179,125 @@ TEST(WorkerMultiThreadedTest, SetGetConfiguration) {
   ASSERT_EQ("TestReturn", configuration);
 }
 
+// Contexts return the configuration of the worker which was current when the
+// task started
+struct ConfiguredContext : ContextBaseT<int, std::string, std::string> {
+  std::string run(int const &) override { return configuration(); }
+};
+
+struct ConfiguredWorker
+    : public WorkerMultiThreadedT<int, std::string, ConfiguredContext,
+                                  ServiceBroker, std::string> {
+  using Base = WorkerMultiThreadedT<int, std::string, ConfiguredContext,
+                                    ServiceBroker, std::string>;
+  using Base::Base;
+  void preprocess(int const &a) override { schedule(a); }
+  std::string postprocess(std::string &&a) override { return a; }
+};
+
+TEST(WorkerMultiThreadedTest, ConfigurationSnapshot) {
+  const int tasks = 2000;
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("input");
+  ExecutorOptions options;
+  options.executors = 4;
+  ConfiguredWorker worker("worker", broker, input);
+  worker.set_executor_options(options);
+  worker.set_configuration("a");
+
+  std::vector<std::string> received;
+  std::mutex mtx;
+  broker->register_callback("worker.result", [&](std::string value) {
+    std::lock_guard<std::mutex> lk(mtx);
+    received.push_back(value);
+  });
+  auto wait_for = [&](std::size_t count) {
+    while (true) {
+      std::lock_guard<std::mutex> lk(mtx);
+      if (received.size() == count) {
+        break;
+      }
+    }
+  };
+  for (int i = 0; i < tasks; ++i) {
+    input(i);
+  }
+  wait_for(tasks);
+  // Swap the configuration while the tasks are executed
+  for (int i = 0; i < tasks; ++i) {
+    input(i);
+    if (i == tasks / 2) {
+      worker.set_configuration("b");
+    }
+  }
+  wait_for(2 * tasks);
+
+  ASSERT_EQ("b", worker.get_configuration());
+  ASSERT_EQ(std::vector<std::string>(tasks, "a"),
+            std::vector<std::string>(received.begin(),
+                                     received.begin() + tasks));
+  ASSERT_EQ("b", received.back());
+  for (auto const &value : received) {
+    ASSERT_TRUE(value == "a" || value == "b");
+  }
+}
+
+// Configuration set while a task runs is applied before the next task
+struct BlockingWorker
+    : public WorkerSingleThreadedT<int, int, ServiceBroker, std::string> {
+  using Base = WorkerSingleThreadedT<int, int, ServiceBroker, std::string>;
+  using Base::Base;
+
+  std::promise<void> started;
+  std::shared_future<void> release;
+  std::atomic<bool> running{false};
+  std::atomic<bool> overlapped{false};
+  std::vector<std::string> applied;
+
+  int run(int const &a) override {
+    running = true;
+    if (a == 0) {
+      started.set_value();
+      release.wait();
+    }
+    running = false;
+    return a;
+  }
+
+ protected:
+  void set_configuration_(std::string const &value) override {
+    overlapped = overlapped || running;
+    applied.push_back(value);
+  }
+  std::string get_configuration_() const override { return ""; }
+};
+
+TEST(WorkerSingleThreadedTest, DeferredConfiguration) {
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("input");
+  BlockingWorker worker("worker", broker, input);
+  std::promise<void> release;
+  worker.release = release.get_future().share();
+
+  std::atomic<int> results{0};
+  broker->register_callback("worker.result", [&](int) { ++results; });
+  input(0);
+  worker.started.get_future().wait();
+  worker.set_configuration("a");
+  worker.set_configuration("b");
+  release.set_value();
+  input(1);
+  while (results != 2) {
+    std::this_thread::yield();
+  }
+
+  // Only the latest configuration is applied, between the tasks
+  ASSERT_FALSE(worker.overlapped);
+  ASSERT_EQ(std::vector<std::string>{"b"}, worker.applied);
+  worker.set_configuration("c");
+  ASSERT_EQ((std::vector<std::string>{"b", "c"}), worker.applied);
+}
+
 /// <summary>
 /// Connect two workers statically
 /// </summary>
@@ -202,3 +332,475 @@ TEST(Workers, CompileTimeConnectionCheck) {
   MockSingleThreadedWorkerA a("a", broker, {});
   MockSingleThreadedWorkerB b("b", broker, a.result_signal);
 }
+
+/// <summary>
+/// Run tasks in batches
+/// </summary>
+struct BatchWorker
+    : public WorkerSingleThreadedT<int, int, ServiceBroker,
+                                   trivial_configuration_type> {
+  using Base = WorkerSingleThreadedT<int, int, ServiceBroker,
+                                     trivial_configuration_type>;
+  using Base::Base;
+
+  std::vector<int> run_batch(std::vector<int> const &tasks) override {
+    batch_sizes.push_back(tasks.size());
+    return tasks;
+  }
+
+  std::vector<std::size_t> batch_sizes;
+};
+
+TEST(Workers, Batch) {
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("input");
+  std::unique_ptr<BatchWorker> worker(
+      new BatchWorker("worker", broker, input));
+  ASSERT_FALSE(broker->symbol("worker.batch_result"));
+  BatchOptions options;
+  options.max_size = 8;
+  options.max_delay = std::chrono::seconds(10);
+  options.emit_batch = true;
+  worker->set_batch_options(options);
+  ASSERT_TRUE(broker->symbol("worker.batch_result"));
+
+  std::promise<std::vector<int>> batch;
+  std::atomic<int> results{0};
+  broker->register_callback("worker.batch_result",
+                            [&batch](std::vector<int> results) {
+                              batch.set_value(results);
+                            });
+  broker->register_callback("worker.result", [&results](int) { ++results; });
+  for (int i = 0; i < 8; ++i) {
+    input(i);
+  }
+
+  ASSERT_EQ((std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7}),
+            batch.get_future().get());
+  ASSERT_EQ(std::vector<std::size_t>{8}, worker->batch_sizes);
+  // Results of the batch are not signalled one by one
+  worker.reset();
+  ASSERT_EQ(0, results);
+}
+
+TEST(LatencyHistogramTest, Percentiles) {
+  LatencyHistogram histogram;
+  ASSERT_TRUE(histogram.snapshot().empty());
+  for (int i = 1; i <= 1000; ++i) {
+    histogram.record(std::chrono::microseconds(i));
+  }
+  auto snapshot = histogram.snapshot();
+  ASSERT_EQ(1000u, snapshot.count);
+  ASSERT_EQ(1000u, snapshot.min);
+  ASSERT_EQ(1000000u, snapshot.max);
+  ASSERT_NEAR(500500.0, snapshot.mean(), 1.0);
+  // Percentiles are known within the width of a bucket
+  ASSERT_NEAR(500000.0, snapshot.percentile(0.5), 500000 * 0.04);
+  ASSERT_NEAR(990000.0, snapshot.percentile(0.99), 990000 * 0.04);
+  ASSERT_EQ(1000000u, snapshot.percentile(1.0));
+  ASSERT_EQ(1000u, snapshot.percentile(0.0));
+
+  // Values up to 32 ns have a bucket each, larger ones are clamped
+  const std::size_t buckets = LatencyHistogram::bucket_count;
+  for (std::uint64_t value : {0ull, 31ull, 32ull, 1000ull, 1ull << 39}) {
+    auto bucket = LatencyHistogram::bucket(value);
+    ASSERT_LE(value, LatencyHistogram::upper_bound(bucket));
+    ASSERT_LT(bucket, buckets);
+  }
+  ASSERT_EQ(31u, LatencyHistogram::upper_bound(LatencyHistogram::bucket(31)));
+
+  // Snapshot with reset starts a new interval, snapshots merge
+  auto interval = histogram.snapshot(true);
+  ASSERT_TRUE(histogram.snapshot().empty());
+  histogram.record(std::chrono::seconds(1));
+  interval.merge(histogram.snapshot());
+  ASSERT_EQ(1001u, interval.count);
+  ASSERT_EQ(1000000000u, interval.max);
+}
+
+TEST(Workers, LatencyMetrics) {
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("input");
+  BatchWorker worker("worker", broker, input);
+  std::atomic<int> results{0};
+  broker->register_callback("worker.result", [&results](int) { ++results; });
+  for (int i = 0; i < 10; ++i) {
+    input(i);
+  }
+  while (results != 10) {
+    std::this_thread::yield();
+  }
+
+  auto metrics = broker->call<LatencyMetrics>("metrics.worker", true);
+  ASSERT_EQ(1u, metrics.size());
+  ASSERT_EQ(10u, metrics.front().queue_wait.count);
+  ASSERT_EQ(10u, metrics.front().execution.count);
+  ASSERT_EQ(10u, metrics.front().end_to_end.count);
+  ASSERT_LE(metrics.front().execution.max, metrics.front().end_to_end.max);
+  ASSERT_TRUE(worker.latency_metrics().end_to_end.empty());
+}
+
+TEST(TaskQueueTest, Backpressure) {
+  TaskQueue<int> queue;
+  TaskQueueOptions<int> options;
+  options.capacity = 2;
+
+  options.backpressure = Backpressure::DropNewest;
+  queue.set_options(options);
+  ASSERT_TRUE(queue.push_back(1));
+  ASSERT_TRUE(queue.push_back(2));
+  ASSERT_FALSE(queue.push_back(3));
+  ASSERT_EQ(1, queue.pull_front());
+  ASSERT_EQ(2, queue.pull_front());
+  ASSERT_EQ(1u, queue.dropped());
+
+  options.backpressure = Backpressure::DropOldest;
+  queue.set_options(options);
+  queue.push_back(1);
+  queue.push_back(2);
+  ASSERT_TRUE(queue.push_back(3));
+  ASSERT_EQ(2, queue.pull_front());
+  ASSERT_EQ(3, queue.pull_front());
+  ASSERT_EQ(2u, queue.dropped());
+
+  options.backpressure = Backpressure::Coalesce;
+  options.key = [](int const &value) { return value % 10; };
+  queue.set_options(options);
+  queue.push_back(1);
+  queue.push_back(2);
+  queue.push_back(12);
+  ASSERT_EQ(1u, queue.coalesced());
+  queue.push_back(3);
+  queue.push_back(22);
+  ASSERT_EQ(2u, queue.coalesced());
+  ASSERT_EQ(3u, queue.dropped());
+  ASSERT_EQ(22, queue.pull_front());
+  ASSERT_EQ(3, queue.pull_front());
+  // Key of a pulled task is free again
+  queue.push_back(13);
+  queue.push_back(3);
+  ASSERT_EQ(3u, queue.coalesced());
+  ASSERT_EQ(3, queue.pull_front());
+
+  options.backpressure = Backpressure::Block;
+  queue.set_options(options);
+  queue.push_back(1);
+  queue.push_back(2);
+  std::atomic<bool> pushed{false};
+  std::thread producer([&]() {
+    queue.push_back(3);
+    pushed = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ASSERT_FALSE(pushed);
+  ASSERT_EQ(1, queue.pull_front());
+  producer.join();
+  ASSERT_EQ(2u, queue.size());
+  ASSERT_EQ(3u, queue.dropped());
+  ASSERT_EQ(3u, queue.coalesced());
+
+  queue.close();
+  int value;
+  ASSERT_FALSE(queue.pull_front(value));
+  ASSERT_FALSE(queue.push_back(4));
+}
+
+/// <summary>
+/// Takes about 100 us per task and measures the time spent running the tasks
+/// </summary>
+struct SlowWorker
+    : public WorkerSingleThreadedT<int, int, ServiceBroker,
+                                   trivial_configuration_type> {
+  using Base = WorkerSingleThreadedT<int, int, ServiceBroker,
+                                     trivial_configuration_type>;
+  using Base::Base;
+
+  int run(int const &arg) override {
+    auto start_time = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+    busy += std::chrono::steady_clock::now() - start_time;
+    return arg;
+  }
+
+  std::chrono::steady_clock::duration busy{0};
+};
+
+// Producer is much faster than the worker. Queue stays within its capacity,
+// every task is either processed or dropped and the worker runs at its
+// service rate.
+TEST(Workers, Backpressure) {
+  const std::size_t capacity = 64;
+  const int produced = 20000;
+  for (auto backpressure :
+       {Backpressure::DropNewest, Backpressure::DropOldest,
+        Backpressure::Coalesce}) {
+    auto broker = std::make_shared<ServiceBroker>();
+    Service<void, int> input("input");
+    SlowWorker worker("worker", broker, input);
+    TaskQueueOptions<int> options;
+    options.capacity = capacity;
+    options.backpressure = backpressure;
+    options.key = [](int const &value) { return value % 1024; };
+    worker.set_queue_options(options);
+
+    std::atomic<std::size_t> processed{0};
+    broker->register_callback("worker.result", [&processed](int) {
+      ++processed;
+    });
+
+    auto start_time = std::chrono::steady_clock::now();
+    std::size_t max_pending = 0;
+    for (int i = 0; i < produced; ++i) {
+      input(i);
+      max_pending = std::max(max_pending, worker.pending());
+      if (i % 100 == 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+      }
+    }
+    while (worker.pending() != 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start_time;
+    // Last task may still be running
+    while (processed + worker.dropped() + worker.coalesced() != produced) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    ASSERT_LE(max_pending, capacity);
+    ASSERT_GT(worker.dropped(), 0u);
+    ASSERT_GT(processed, 0u);
+    ASSERT_GT(worker.busy * 2, elapsed);
+  }
+}
+
+// Blocked producer runs at the service rate of the worker without drops
+TEST(Workers, BackpressureBlock) {
+  const std::size_t capacity = 16;
+  const int produced = 1000;
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("input");
+  SlowWorker worker("worker", broker, input);
+  TaskQueueOptions<int> options;
+  options.capacity = capacity;
+  worker.set_queue_options(options);
+
+  std::atomic<int> processed{0};
+  broker->register_callback("worker.result", [&processed](int) {
+    ++processed;
+  });
+
+  std::size_t max_pending = 0;
+  for (int i = 0; i < produced; ++i) {
+    input(i);
+    max_pending = std::max(max_pending, worker.pending());
+  }
+  while (processed != produced) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_LE(max_pending, capacity);
+  ASSERT_EQ(0u, worker.dropped());
+}
+
+/// <summary>
+/// Increments the task on the shared scheduler
+/// </summary>
+struct ScheduledWorker
+    : public WorkerSingleThreadedT<int, int, ServiceBroker,
+                                   trivial_configuration_type,
+                                   SharedScheduler> {
+  using Base = WorkerSingleThreadedT<int, int, ServiceBroker,
+                                     trivial_configuration_type,
+                                     SharedScheduler>;
+  using Base::Base;
+
+  int run(int const &arg) override { return arg + 1; }
+};
+
+// Chain of many workers shares the threads of the executor and each of them
+// keeps the order of the tasks
+TEST(Workers, SharedScheduler) {
+  const int workers = 200;
+  const int tasks = 100;
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("input");
+  std::vector<std::unique_ptr<ScheduledWorker>> chain;
+  chain.emplace_back(new ScheduledWorker("w0", broker, input));
+  for (int i = 1; i < workers; ++i) {
+    std::vector<std::string> const inputs{"w" + std::to_string(i - 1)};
+    chain.emplace_back(
+        new ScheduledWorker("w" + std::to_string(i), broker, inputs));
+  }
+
+  std::vector<int> received;
+  std::mutex mtx;
+  broker->register_callback("w" + std::to_string(workers - 1) + ".result",
+                            [&](int value) {
+                              std::lock_guard<std::mutex> lk(mtx);
+                              received.push_back(value);
+                            });
+  for (int i = 0; i < tasks; ++i) {
+    input(i);
+  }
+  while (true) {
+    std::lock_guard<std::mutex> lk(mtx);
+    if (received.size() == static_cast<std::size_t>(tasks)) {
+      break;
+    }
+  }
+
+  std::vector<int> expected(tasks);
+  std::iota(expected.begin(), expected.end(), workers);
+  ASSERT_EQ(expected, received);
+}
+
+TEST(Workers, Placement) {
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("input");
+  BatchWorker worker("worker", broker, input);
+  // First CPU the test may run on
+  auto cpu = affinity::describe("test", affinity::current_thread_id()).cpus[0];
+  Placement placement;
+  placement.cpus = {cpu};
+  worker.set_placement(placement);
+
+  std::promise<void> done;
+  broker->register_callback("worker.result",
+                            [&done](int) { done.set_value(); });
+  input(1);
+  done.get_future().wait();
+
+  auto topology = worker.topology();
+  ASSERT_EQ(1u, topology.size());
+  ASSERT_EQ("worker", topology[0].name);
+  ASSERT_EQ(std::vector<unsigned>{cpu}, topology[0].cpus);
+  ASSERT_EQ(static_cast<int>(cpu), topology[0].cpu);
+  ASSERT_NE(std::string::npos, topology_report(topology).find("worker: "));
+}
+
+/// <summary>
+/// Increments the task and records the thread it ran on
+/// </summary>
+struct ThreadRecordingWorker
+    : public WorkerSingleThreadedT<int, int, ServiceBroker,
+                                   trivial_configuration_type> {
+  using Base = WorkerSingleThreadedT<int, int, ServiceBroker,
+                                     trivial_configuration_type>;
+  using Base::Base;
+
+  int run(int const &arg) override {
+    std::lock_guard<std::mutex> lk(mtx);
+    threads.insert(std::this_thread::get_id());
+    return arg + 1;
+  }
+
+  std::set<std::thread::id> thread_ids() {
+    std::lock_guard<std::mutex> lk(mtx);
+    return threads;
+  }
+
+  std::mutex mtx;
+  std::set<std::thread::id> threads;
+};
+
+// Chain a -> b -> c is fused, the branches after c keep their threads
+TEST(Workers, Fusion) {
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("source.result");
+  broker->add_service(input);
+  PipelineT<ServiceBroker> pipeline(broker);
+  auto &a = pipeline.add<ThreadRecordingWorker>("a", {"source"});
+  auto &b = pipeline.add<ThreadRecordingWorker>("b", {"a"});
+  auto &c = pipeline.add<ThreadRecordingWorker>("c", {"b"});
+  auto &d = pipeline.add<ThreadRecordingWorker>("d", {"c"});
+  auto &e = pipeline.add<ThreadRecordingWorker>("e", {"c"});
+  ASSERT_EQ((std::vector<std::string>{"b", "c"}), pipeline.fuse());
+  ASSERT_TRUE(b.fused());
+  ASSERT_FALSE(d.fused());
+
+  std::vector<int> received;
+  std::mutex mtx;
+  auto receive = [&](int value) {
+    std::lock_guard<std::mutex> lk(mtx);
+    received.push_back(value);
+  };
+  broker->register_callback("d.result", receive);
+  broker->register_callback("e.result", receive);
+  for (int i = 0; i < 10; ++i) {
+    input(i);
+  }
+  while (true) {
+    std::lock_guard<std::mutex> lk(mtx);
+    if (received.size() == 20u) {
+      break;
+    }
+  }
+
+  std::sort(received.begin(), received.end());
+  for (int i = 0; i < 20; ++i) {
+    ASSERT_EQ(i / 2 + 4, received[i]);
+  }
+  auto threads = a.thread_ids();
+  ASSERT_EQ(1u, threads.size());
+  ASSERT_EQ(threads, b.thread_ids());
+  ASSERT_EQ(threads, c.thread_ids());
+  ASSERT_NE(threads, d.thread_ids());
+  ASSERT_NE(threads, e.thread_ids());
+  ASSERT_EQ(10u, c.latency_metrics().execution.count);
+}
+
+/// <summary>
+/// Records the order of its tasks and whether they overlapped
+/// </summary>
+struct OrderRecordingWorker
+    : public WorkerSingleThreadedT<int, int, ServiceBroker,
+                                   trivial_configuration_type> {
+  using Base = WorkerSingleThreadedT<int, int, ServiceBroker,
+                                     trivial_configuration_type>;
+  using Base::Base;
+
+  int run(int const &arg) override {
+    if (++running > 1) {
+      overlapped = true;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      order.push_back(arg);
+    }
+    --running;
+    return arg;
+  }
+
+  std::atomic<int> running{0};
+  std::atomic<bool> overlapped{false};
+  std::mutex mtx;
+  std::vector<int> order;
+};
+
+// Tasks queued when the chain is fused run first, one at a time and in order
+TEST(Workers, FusionWithQueuedTasks) {
+  auto broker = std::make_shared<ServiceBroker>();
+  Service<void, int> input("source.result");
+  broker->add_service(input);
+  PipelineT<ServiceBroker> pipeline(broker);
+  pipeline.add<ThreadRecordingWorker>("a", {"source"});
+  auto &b = pipeline.add<OrderRecordingWorker>("b", {"a"});
+  std::atomic<int> results{0};
+  broker->register_callback("b.result", [&](int) { ++results; });
+  for (int i = 0; i < 100; ++i) {
+    input(i);
+  }
+  ASSERT_EQ((std::vector<std::string>{"b"}), pipeline.fuse());
+  for (int i = 100; i < 200; ++i) {
+    input(i);
+  }
+  while (results != 200) {
+    std::this_thread::yield();
+  }
+
+  ASSERT_FALSE(b.overlapped);
+  std::vector<int> expected(200);
+  std::iota(expected.begin(), expected.end(), 1);
+  std::lock_guard<std::mutex> lk(b.mtx);
+  ASSERT_EQ(expected, b.order);
+}